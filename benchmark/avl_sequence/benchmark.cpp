@@ -0,0 +1,108 @@
+///
+/// 测试avl_sequence在随机位置插入、删除与按下标访问的耗时
+///
+/// 共500,000个节点，每次在随机位置插入一个节点，然后按随机下标访问，最后每次删除随机位置的节点。
+/// 对比avl_sequence与保存节点指针的std::vector。std::vector在中间插入与删除时需要移动O(n)个元素，
+/// 而avl_sequence只需要O(log n)时间；按下标访问时std::vector为O(1)，avl_sequence为O(log n)。
+///
+
+#include "tinystl/avl_sequence.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+struct Piece : public tinystl::avl_rank_node {
+  int64_t mValue = 0;
+};
+
+constexpr const int maxn = 500000;
+
+Piece pieces[maxn];
+
+std::vector<size_t> insert_positions;
+std::vector<size_t> access_positions;
+std::vector<size_t> erase_positions;
+
+template <class Func>
+void run_step(const char *name, const char *step, Func &&func) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  int64_t sum = func();
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << name << " " << step << " " << maxn << " nodes (sum " << sum << "): "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << "ms\n";
+}
+
+void run_avl_sequence() {
+  tinystl::avl_sequence<Piece> sequence;
+
+  run_step("avl_sequence", "insert", [&] {
+    for (int i = 0; i < maxn; ++i)
+      sequence.insert(insert_positions[i], &pieces[i]);
+    return int64_t(sequence.size());
+  });
+
+  run_step("avl_sequence", "access", [&] {
+    int64_t sum = 0;
+    for (size_t index : access_positions)
+      sum += sequence[index].mValue;
+    return sum;
+  });
+
+  run_step("avl_sequence", "erase", [&] {
+    int64_t sum = 0;
+    for (size_t index : erase_positions)
+      sum += sequence.erase(index)->mValue;
+    return sum;
+  });
+}
+
+void run_vector() {
+  std::vector<Piece *> sequence;
+
+  run_step("std::vector", "insert", [&] {
+    for (int i = 0; i < maxn; ++i)
+      sequence.insert(sequence.begin() + insert_positions[i], &pieces[i]);
+    return int64_t(sequence.size());
+  });
+
+  run_step("std::vector", "access", [&] {
+    int64_t sum = 0;
+    for (size_t index : access_positions)
+      sum += sequence[index]->mValue;
+    return sum;
+  });
+
+  run_step("std::vector", "erase", [&] {
+    int64_t sum = 0;
+    for (size_t index : erase_positions) {
+      sum += sequence[index]->mValue;
+      sequence.erase(sequence.begin() + index);
+    }
+    return sum;
+  });
+}
+
+int main() {
+  srand(time(nullptr));
+  for (int i = 0; i < maxn; ++i) {
+    pieces[i].mValue = rand();
+    insert_positions.push_back(rand() % (i + 1));
+    access_positions.push_back(rand() % maxn);
+    erase_positions.push_back(rand() % (maxn - i));
+  }
+
+  run_avl_sequence();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_vector();
+
+  return 0;
+}
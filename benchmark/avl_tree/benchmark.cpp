@@ -25,31 +25,74 @@
 /// 因为原本递归算法要进行频繁的压栈弹栈操作，很费时间，所以我并没有对clear的时间抱很大的期望；
 /// 而且编译器能够对递归算法进行的优化实际上非常有限，但结果远超我的预期。
 ///
+/// find的耗时主要来自沿指针向下查找时的缓存缺失。find_batch让一批查找逐层同步前进，并预取每个查找的
+/// 下一个节点，使不同查找的缓存缺失相互重叠。这里分别测试每批1、8、16、32个键的耗时。
+///
+/// 另外使用1,000,000个带公共前缀的字符串分别测试bool比较器与三路比较器，并统计比较次数。
+/// bool比较器在每一层需要比较两次（a < b与b < a），而三路比较器每一层只需比较一次。
+///
+/// avl_tree<avl_compact_node>将平衡因子存放在父节点指针的低2位中，节点头部从32字节减小到24字节。
+/// avl_parentless_tree的节点不保存父节点指针，节点头部同样为24字节，但插入与删除需要在栈上记录路径，
+/// 按指针删除时还需要先用比较器重新查找路径，迭代器也更重。这里对三种节点布局分别测试插入、查找、
+/// 遍历与逐个删除的耗时。
+///
+/// 最后使用递增的键分别测试insert_unique与insert_back，模拟时间戳、序列号等单调递增的键。
+/// insert_back只需要与最后一个节点比较一次，不需要从根节点向下查找。
+/// assign_sorted则直接将有序节点链接为完全平衡的树，不进行比较与旋转，时间复杂度为O(n)。
+///
+/// 批量插入测试向已有节点的树中插入一批随机节点，分别逐个调用insert_multi与调用insert_bulk_multi。
+/// 批量较大时insert_bulk_multi先排序，再与原有节点归并后重建，时间复杂度为O(n + m)。
+///
+/// split与join2的时间复杂度均为O(log n)，测试在随机位置分裂后再合并的平均耗时。
+///
+/// 集合运算基于split与join实现，合并大小为m的树的时间复杂度为O(m log(n / m + 1))。
+/// 这里对比逐个insert_unique与set_union合并两棵树的耗时。
+///
+/// avl_rank_node额外保存子树大小，select与rank的时间复杂度为O(log n)。这里用1,000,000个节点
+/// 测试百分位数查询，对比select、std::next与从begin()开始逐个移动迭代器的耗时。avl_rank_node的迭代器
+/// 是随机访问迭代器，std::next的时间复杂度同样为O(log n)。
+///
+/// avl_augmented_node允许节点自行维护子树的聚合值（这里为子树的和与最大值），fold_range将区间分解为
+/// O(log n)个节点与子树。测试窗口为键范围1/10的区间求和与求最大值，对比fold_range与逐个遍历的耗时。
+///
 
 #include "avlmini.h"
+#include "tinystl/avl_parentless_tree.h"
 #include "tinystl/avl_tree.h"
 
 #include <algorithm>
 #include <chrono>
+#include <cinttypes>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <iostream>
+#include <string>
 #include <thread>
+#include <vector>
 
-struct IntElement : public tinystl::avl_node {
+template <class Node>
+struct BasicIntElement : public Node {
   int64_t mValue = 0;
 
-  constexpr IntElement(int64_t value = 0) noexcept
-      : avl_node(), mValue(value) {}
+  constexpr BasicIntElement(int64_t value = 0) noexcept
+      : Node(), mValue(value) {}
 
-  constexpr bool operator<(const IntElement &rhs) const noexcept {
+  constexpr bool operator<(const BasicIntElement &rhs) const noexcept {
     return mValue < rhs.mValue;
   }
 
   constexpr operator int64_t() const noexcept { return mValue; }
 };
 
+using IntElement = BasicIntElement<tinystl::avl_node>;
+using CompactIntElement = BasicIntElement<tinystl::avl_compact_node>;
+using RankIntElement = BasicIntElement<tinystl::avl_rank_node>;
+using ParentlessIntElement = BasicIntElement<tinystl::avl_parentless_node>;
+
+using CompactIntTree =
+    tinystl::avl_tree<CompactIntElement, std::less<CompactIntElement>, tinystl::avl_compact_node>;
+
 struct IntElement2 {
   struct avl_node node;
   int64_t mValue = 0;
@@ -65,11 +108,77 @@ constexpr const int maxn = 10000000;
 
 IntElement elements[maxn];
 IntElement2 elements2[maxn];
+CompactIntElement compact_elements[maxn];
 
-void run_avl_tree() {
+struct StringElement : public tinystl::avl_node {
+  std::string mValue;
+};
+
+size_t string_comparisons = 0;
+
+struct StringLess {
+  bool operator()(const StringElement &lhs, const StringElement &rhs) const noexcept {
+    ++string_comparisons;
+    return lhs.mValue < rhs.mValue;
+  }
+};
+
+struct StringThreeWay {
+  int operator()(const StringElement &lhs, const StringElement &rhs) const noexcept {
+    ++string_comparisons;
+    return lhs.mValue.compare(rhs.mValue);
+  }
+};
+
+constexpr const int maxs = 1000000;
+
+StringElement strings[maxs];
+
+template <class Compare>
+void run_string_avl_tree(const char *name) {
+  string_comparisons = 0;
   auto start = std::chrono::high_resolution_clock::now();
 
-  tinystl::avl_tree<IntElement> tree;
+  tinystl::avl_tree<StringElement, Compare> tree;
+  for (auto &element : strings) {
+    tree.insert_unique(&element);
+  }
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << name << " insert " << maxs << " strings: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << ", comparisons: " << string_comparisons << '\n';
+
+  // search
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  string_comparisons = 0;
+  start = std::chrono::high_resolution_clock::now();
+  for (const auto &e : strings) {
+    auto p = tree.find(e);
+    if (p == nullptr) {
+      fprintf(stderr, "%s should be found but not.\n", e.mValue.c_str());
+      std::abort();
+    }
+  }
+  period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << name << " find " << maxs << " strings: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << ", comparisons: " << string_comparisons << '\n';
+
+  tree.clear([](StringElement *) {});
+}
+
+template <class Node>
+void run_avl_tree(BasicIntElement<Node> (&elements)[maxn], const char *name) {
+  using Element = BasicIntElement<Node>;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  tinystl::avl_tree<Element, std::less<Element>, Node> tree;
   for (auto &element : elements) {
     tree.insert_unique(&element);
   }
@@ -77,7 +186,7 @@ void run_avl_tree() {
   auto period = std::chrono::high_resolution_clock::now() - start;
 
   std::cout
-      << "avl_tree insert " << maxn << " nodes: "
+      << name << " insert " << maxn << " nodes: "
       << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
       << '\n';
 
@@ -88,28 +197,364 @@ void run_avl_tree() {
   for (const auto &e : elements) {
     auto p = tree.find(e);
     if (p == nullptr) {
-      fprintf(stderr, "%lld should be found but not.\n", int64_t(e));
+      fprintf(stderr, "%" PRId64 " should be found but not.\n", int64_t(e));
       std::abort();
     }
   }
   period = std::chrono::high_resolution_clock::now() - start;
 
   std::cout
-      << "avl_tree find " << maxn << " nodes: "
+      << name << " find " << maxn << " nodes: "
       << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
       << '\n';
 
+  // batch search
+  for (int batch : {1, 8, 16, 32}) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    Element *found[32];
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < maxn; i += batch) {
+      int n = std::min(batch, maxn - i);
+      tree.find_batch(&elements[i], n, found);
+      for (int j = 0; j < n; ++j) {
+        if (found[j] == nullptr) {
+          fprintf(stderr, "%" PRId64 " should be found but not.\n", int64_t(elements[i + j]));
+          std::abort();
+        }
+      }
+    }
+    period = std::chrono::high_resolution_clock::now() - start;
+
+    std::cout
+        << name << " find_batch(" << batch << ") " << maxn << " nodes: "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+        << '\n';
+  }
+
   // clear all
   std::this_thread::sleep_for(std::chrono::seconds(1));
 
   start = std::chrono::high_resolution_clock::now();
-  tree.clear([](IntElement *p) { memset(p, 0, sizeof(IntElement)); });
+  tree.clear([](Element *p) { *p = Element(); });
   period = std::chrono::high_resolution_clock::now() - start;
 
   std::cout
-      << "avl_tree clear " << maxn << " nodes: "
+      << name << " clear " << maxn << " nodes: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+}
+
+template <class Tree>
+void run_layout_avl_tree(const char *name) {
+  using Element = typename Tree::value_type;
+  std::vector<Element> nodes;
+  nodes.reserve(maxn);
+  for (const auto &e : elements) {
+    nodes.emplace_back(e.mValue);
+  }
+
+  std::cout << name << " node size: " << sizeof(Element) << " bytes\n";
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  Tree tree;
+  for (auto &node : nodes) {
+    tree.insert_unique(&node);
+  }
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << name << " insert " << maxn << " nodes: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+
+  // search
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  start = std::chrono::high_resolution_clock::now();
+  for (const auto &e : nodes) {
+    if (tree.find(e) == nullptr) {
+      fprintf(stderr, "%" PRId64 " should be found but not.\n", int64_t(e));
+      std::abort();
+    }
+  }
+  period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << name << " find " << maxn << " nodes: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+
+  // traverse
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  int64_t sum = 0;
+  start = std::chrono::high_resolution_clock::now();
+  for (const auto &e : tree) {
+    sum += e.mValue;
+  }
+  period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << name << " traverse " << tree.size() << " nodes: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << ", sum: " << sum << '\n';
+
+  // erase by pointer
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  // Duplicated keys were not inserted.
+  std::vector<Element *> inserted;
+  for (auto &node : nodes) {
+    if (tree.find(node) == &node)
+      inserted.push_back(&node);
+  }
+
+  start = std::chrono::high_resolution_clock::now();
+  for (auto node : inserted) {
+    tree.erase(node);
+  }
+  period = std::chrono::high_resolution_clock::now() - start;
+
+  if (!tree.empty()) {
+    fprintf(stderr, "%zu nodes are left after erase.\n", tree.size());
+    std::abort();
+  }
+
+  std::cout
+      << name << " erase " << inserted.size() << " nodes: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+}
+
+template <class Build>
+void run_sorted_avl_tree(const char *name, Build &&build) {
+  for (int i = 0; i < maxn; ++i) {
+    elements[i] = i;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  tinystl::avl_tree<IntElement> tree;
+  build(tree);
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << "avl_tree " << name << " " << maxn << " sorted nodes: "
       << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
       << '\n';
+
+  tree.clear([](IntElement *p) { *p = IntElement(); });
+}
+
+template <class Insert>
+void run_bulk_avl_tree(int batch, const char *name, Insert &&insert) {
+  for (auto &element : elements) {
+    element = rand();
+  }
+
+  tinystl::avl_tree<IntElement> tree;
+  for (int i = batch; i < maxn; ++i) {
+    tree.insert_multi(&elements[i]);
+  }
+
+  std::vector<IntElement *> nodes;
+  for (int i = 0; i < batch; ++i) {
+    nodes.push_back(&elements[i]);
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  insert(tree, nodes);
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << "avl_tree " << name << " " << batch << " nodes into " << maxn - batch << " nodes: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+
+  tree.clear([](IntElement *p) { *p = IntElement(); });
+}
+
+void run_split_join_avl_tree() {
+  constexpr const int rounds = 100000;
+
+  for (int i = 0; i < maxn; ++i) {
+    elements[i] = i;
+  }
+
+  tinystl::avl_tree<IntElement> tree;
+  tree.assign_sorted(std::begin(elements), std::end(elements));
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  for (int i = 0; i < rounds; ++i) {
+    auto parts = tree.split(IntElement(rand() % maxn));
+    tree       = tinystl::avl_tree<IntElement>::join2(parts.first, parts.second);
+  }
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << "avl_tree split and join2 " << maxn << " nodes " << rounds << " times: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+
+  tree.clear([](IntElement *p) { *p = IntElement(); });
+}
+
+template <class Merge>
+void run_merge_avl_tree(int batch, const char *name, Merge &&merge) {
+  // Nodes of other spread over the whole tree and some of them are duplicated.
+  for (int i = 0; i < maxn; ++i) {
+    elements[i] = (i < batch) ? int64_t(i) * (maxn / batch) + 1 : i;
+  }
+
+  tinystl::avl_tree<IntElement> tree, other;
+  tree.assign_sorted(elements + batch, elements + maxn);
+  other.assign_sorted(elements, elements + batch);
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  size_t dropped = merge(tree, other);
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << "avl_tree " << name << " " << batch << " nodes into " << maxn - batch << " nodes ("
+      << dropped << " dropped): "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+
+  tree.clear([](IntElement *p) { *p = IntElement(); });
+}
+
+RankIntElement rank_elements[maxs];
+
+template <class Query>
+void run_percentile_query(const char *name, int queries, Query &&query) {
+  int64_t sum = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  for (int i = 0; i < queries; ++i) {
+    sum += query(maxs / queries * i);
+  }
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << "avl_tree<avl_rank_node> " << name << " percentile of " << maxs << " nodes (sum " << sum
+      << "): "
+      << std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / queries
+      << "ns\n";
+}
+
+void run_rank_avl_tree() {
+  tinystl::avl_tree<RankIntElement, std::less<RankIntElement>, tinystl::avl_rank_node> tree;
+  for (auto &element : rank_elements) {
+    element = rand();
+    tree.insert_multi(&element);
+  }
+
+  // Iterators of avl_rank_node are random access, so std::next takes O(log n) time while walking
+  // iterators one by one takes O(n) time. All queries should give the same sum.
+  run_percentile_query("select", 100, [&](size_t k) { return tree.select(k)->mValue; });
+  run_percentile_query("std::next", 100, [&](size_t k) {
+    return std::next(tree.begin(), k)->mValue;
+  });
+  run_percentile_query("iterate", 100, [&](size_t k) {
+    auto it = tree.begin();
+    for (; k > 0; --k)
+      ++it;
+    return it->mValue;
+  });
+
+  tree.clear([](RankIntElement *p) { *p = RankIntElement(); });
+}
+
+struct SumIntElement : public tinystl::avl_augmented_node<SumIntElement> {
+  int64_t mValue = 0;
+  int64_t mSum   = 0;
+  int64_t mMax   = 0;
+
+  SumIntElement(int64_t value = 0) noexcept : mValue(value), mSum(value), mMax(value) {}
+
+  bool operator<(const SumIntElement &rhs) const noexcept { return mValue < rhs.mValue; }
+
+  void recompute() noexcept {
+    mSum = mValue;
+    mMax = mValue;
+    for (auto child : {left(), right()}) {
+      if (child != nullptr) {
+        mSum += static_cast<const SumIntElement *>(child)->mSum;
+        mMax  = std::max(mMax, static_cast<const SumIntElement *>(child)->mMax);
+      }
+    }
+  }
+};
+
+SumIntElement sum_elements[maxs];
+
+template <class Query>
+void run_window_query(const char *name, int queries, Query &&query) {
+  int64_t sum = 0;
+  int64_t max = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  for (int i = 0; i < queries; ++i) {
+    int64_t lo = RAND_MAX / queries * i;
+    query(lo, lo + RAND_MAX / 10, sum, max);
+  }
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << "avl_tree<avl_augmented_node> " << name << " window of " << maxs << " nodes (sum " << sum
+      << ", max " << max << "): "
+      << std::chrono::duration_cast<std::chrono::nanoseconds>(period).count() / queries
+      << "ns\n";
+}
+
+void run_augmented_avl_tree() {
+  using tree_type = tinystl::avl_tree<SumIntElement,
+                                      std::less<SumIntElement>,
+                                      tinystl::avl_augmented_node<SumIntElement>>;
+
+  tree_type tree;
+  for (auto &element : sum_elements) {
+    element = SumIntElement(rand());
+    tree.insert_multi(&element);
+  }
+
+  auto fold_range = [&](int64_t lo, int64_t hi, int64_t &sum, int64_t &max) {
+    tree.fold_range(
+        SumIntElement(lo), SumIntElement(hi),
+        [&](const SumIntElement &node) {
+          sum += node.mValue;
+          max  = std::max(max, node.mValue);
+        },
+        [&](const SumIntElement &subtree) {
+          sum += subtree.mSum;
+          max  = std::max(max, subtree.mMax);
+        });
+  };
+  auto iterate = [&](int64_t lo, int64_t hi, int64_t &sum, int64_t &max) {
+    auto last = tree.lower_bound(SumIntElement(hi));
+    for (auto it = tree.lower_bound(SumIntElement(lo)); it != last; ++it) {
+      sum += it->mValue;
+      max  = std::max(max, it->mValue);
+    }
+  };
+
+  // Both queries should give the same sum and max.
+  run_window_query("fold_range", 100, fold_range);
+  run_window_query("iterate", 100, iterate);
+
+  tree.clear([](SumIntElement *p) { *p = SumIntElement(); });
 }
 
 void run_avlmini() {
@@ -147,7 +592,7 @@ void run_avlmini() {
   for (const auto &e : elements2) {
     auto p = static_cast<IntElement2 *>(avl_tree_find(&tree2, &e));
     if (p == nullptr) {
-      fprintf(stderr, "%lld should be found but not.\n", e.mValue);
+      fprintf(stderr, "%" PRId64 " should be found but not.\n", e.mValue);
       std::abort();
     }
   }
@@ -177,11 +622,83 @@ int main() {
   for (size_t i = 0; i < maxn; ++i) {
     elements[i] = rand();
     elements2[i] = elements[i].mValue;
+    compact_elements[i] = elements[i].mValue;
+  }
+
+  for (auto &element : strings) {
+    element.mValue = "tinystl/benchmark/avl_tree/key/" + std::to_string(rand());
   }
 
   run_avlmini();
   std::this_thread::sleep_for(std::chrono::seconds(1));
-  run_avl_tree();
+  run_avl_tree(elements, "avl_tree");
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_avl_tree(compact_elements, "avl_tree<avl_compact_node>");
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_layout_avl_tree<tinystl::avl_tree<IntElement>>("avl_tree");
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_layout_avl_tree<CompactIntTree>("avl_tree<avl_compact_node>");
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_layout_avl_tree<tinystl::avl_parentless_tree<ParentlessIntElement>>("avl_parentless_tree");
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_string_avl_tree<StringLess>("avl_tree<bool compare>");
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_string_avl_tree<StringThreeWay>("avl_tree<three-way compare>");
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_sorted_avl_tree("insert_unique", [](tinystl::avl_tree<IntElement> &tree) {
+    for (auto &element : elements)
+      tree.insert_unique(&element);
+  });
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_sorted_avl_tree("insert_back", [](tinystl::avl_tree<IntElement> &tree) {
+    for (auto &element : elements)
+      tree.insert_back(&element);
+  });
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_sorted_avl_tree("assign_sorted", [](tinystl::avl_tree<IntElement> &tree) {
+    tree.assign_sorted(std::begin(elements), std::end(elements));
+  });
+
+  auto insert_multi = [](tinystl::avl_tree<IntElement> &tree, std::vector<IntElement *> &nodes) {
+    for (auto node : nodes)
+      tree.insert_multi(node);
+  };
+  auto insert_bulk_multi = [](tinystl::avl_tree<IntElement> &tree,
+                              std::vector<IntElement *> &nodes) {
+    tree.insert_bulk_multi(nodes.begin(), nodes.end());
+  };
+  for (int batch : {maxn / 100, maxn / 10, maxn / 2}) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    run_bulk_avl_tree(batch, "insert_multi", insert_multi);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    run_bulk_avl_tree(batch, "insert_bulk_multi", insert_bulk_multi);
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_split_join_avl_tree();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_rank_avl_tree();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_augmented_avl_tree();
+
+  auto insert_unique = [](tinystl::avl_tree<IntElement> &tree,
+                          tinystl::avl_tree<IntElement> &other) {
+    size_t dropped = 0;
+    other.clear([&](IntElement *p) { dropped += tree.insert_unique(p) ? 0 : 1; });
+    return dropped;
+  };
+  auto set_union = [](tinystl::avl_tree<IntElement> &tree, tinystl::avl_tree<IntElement> &other) {
+    size_t dropped = 0;
+    tree.set_union(other, [&](IntElement *) { dropped += 1; });
+    return dropped;
+  };
+  for (int batch : {maxn / 1000, maxn / 10}) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    run_merge_avl_tree(batch, "insert_unique", insert_unique);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    run_merge_avl_tree(batch, "set_union", set_union);
+  }
 
   return 0;
 }
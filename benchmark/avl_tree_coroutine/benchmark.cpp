@@ -0,0 +1,100 @@
+///
+/// 测试协程交错查找的耗时
+///
+/// 共10,000,000个随机节点，依次查找全部节点。对比逐个调用find、每批16个键调用find_batch，以及同时
+/// 进行1、8、16、32个coro_find查找的耗时。协程在预取下一个节点后挂起，调度器轮流恢复各个查找，
+/// 使不同查找的缓存缺失相互重叠。
+///
+
+#include "tinystl/avl_tree_coroutine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#if !defined(__cpp_impl_coroutine)
+#error "This benchmark requires C++20 coroutines."
+#endif
+
+struct IntElement : public tinystl::avl_node {
+  int64_t mValue = 0;
+
+  constexpr IntElement(int64_t value = 0) noexcept : tinystl::avl_node(), mValue(value) {}
+
+  constexpr bool operator<(const IntElement &rhs) const noexcept {
+    return mValue < rhs.mValue;
+  }
+};
+
+constexpr const int maxn = 10000000;
+
+IntElement elements[maxn];
+
+tinystl::avl_tree<IntElement> tree;
+
+template <class Find>
+void run_find(const char *name, Find &&find) {
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  size_t found = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  find(found);
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  if (found != maxn) {
+    fprintf(stderr, "%s found %zu of %d nodes.\n", name, found, maxn);
+    std::abort();
+  }
+
+  std::cout
+      << "avl_tree " << name << " " << maxn << " nodes: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+}
+
+template <size_t Width>
+void run_interleave() {
+  std::string name = "coro_find(" + std::to_string(Width) + ")";
+  run_find(name.c_str(), [](size_t &found) {
+    tinystl::interleave<Width>(
+        maxn, [](size_t i) { return tinystl::coro_find(tree, elements[i]); },
+        [&](size_t, IntElement *p) { found += (p != nullptr) ? 1 : 0; });
+  });
+}
+
+int main() {
+  srand(time(nullptr));
+  for (auto &element : elements) {
+    element = rand();
+    tree.insert_multi(&element);
+  }
+
+  run_find("find", [](size_t &found) {
+    for (const auto &e : elements)
+      found += (tree.find(e) != nullptr) ? 1 : 0;
+  });
+
+  run_find("find_batch(16)", [](size_t &found) {
+    IntElement *result[16];
+    for (int i = 0; i < maxn; i += 16) {
+      int n = std::min(16, maxn - i);
+      tree.find_batch(&elements[i], n, result);
+      found += std::count_if(result, result + n, [](IntElement *p) { return p != nullptr; });
+    }
+  });
+
+  run_interleave<1>();
+  run_interleave<8>();
+  run_interleave<16>();
+  run_interleave<32>();
+
+  tree.clear([](IntElement *p) { *p = IntElement(); });
+  return 0;
+}
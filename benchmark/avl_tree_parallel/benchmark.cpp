@@ -0,0 +1,79 @@
+///
+/// 测试avl_tree并行集合运算的可扩展性
+///
+/// 两棵树各包含10,000,000个节点，分别为2的倍数与3的倍数，部分节点重复。
+/// 线程数从1增加到硬件线程数，分别测试set_union与set_intersection的耗时。
+/// 集合运算基于split与join，左右两半的递归互不相关，可以交给不同的线程执行；
+/// 节点数少于grain的子树则顺序执行，避免创建线程的开销超过计算本身。
+///
+
+#include "tinystl/avl_tree_parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+struct IntElement : public tinystl::avl_node {
+  int64_t mValue = 0;
+
+  constexpr IntElement(int64_t value = 0) noexcept : tinystl::avl_node(), mValue(value) {}
+
+  constexpr bool operator<(const IntElement &rhs) const noexcept {
+    return mValue < rhs.mValue;
+  }
+};
+
+constexpr const int maxn = 10000000;
+
+IntElement lhs_elements[maxn];
+IntElement rhs_elements[maxn];
+
+template <class Operation>
+void run_set_operation(const char *name, unsigned threads, Operation &&operation) {
+  for (int i = 0; i < maxn; ++i) {
+    lhs_elements[i] = int64_t(i) * 2;
+    rhs_elements[i] = int64_t(i) * 3;
+  }
+
+  tinystl::avl_tree<IntElement> lhs, rhs;
+  lhs.assign_sorted(std::begin(lhs_elements), std::end(lhs_elements));
+  rhs.assign_sorted(std::begin(rhs_elements), std::end(rhs_elements));
+
+  std::atomic<size_t> dropped{0};
+  auto handler = [&](IntElement *) { dropped.fetch_add(1, std::memory_order_relaxed); };
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  operation(lhs, rhs, handler, threads);
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << "avl_tree " << name << " " << threads << " threads, " << lhs.size() << " nodes left, "
+      << dropped.load() << " dropped: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << '\n';
+}
+
+int main() {
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads)) {
+    run_set_operation("set_union", threads, [](auto &lhs, auto &rhs, auto &handler, unsigned n) {
+      tinystl::parallel_set_union(lhs, rhs, handler, n);
+    });
+    run_set_operation(
+        "set_intersection", threads,
+        [](auto &lhs, auto &rhs, auto &handler, unsigned n) {
+          tinystl::parallel_set_intersection(lhs, rhs, handler, n);
+        });
+
+    if (threads == max_threads)
+      break;
+  }
+
+  return 0;
+}
@@ -0,0 +1,160 @@
+///
+/// 测试concurrent_avl_tree在写多场景下的可扩展性
+///
+/// 键的范围为[0, 1,000,000)，开始时树中有一半的键。每个线程不断随机选择一个键，以50%的概率查找，
+/// 25%的概率插入，25%的概率删除，持续1秒后统计吞吐量。线程数从1增加到硬件线程数，多于核数的
+/// 线程只会互相抢占，不能说明可扩展性。对比使用std::mutex保护的avl_tree与concurrent_avl_tree，
+/// 后者每个线程持有一个epoch_participant，删除的内部节点由它延迟回收。
+///
+
+#include "tinystl/concurrent_avl_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct IntElement : public tinystl::avl_node {
+  int64_t mValue = 0;
+
+  constexpr IntElement(int64_t value = 0) noexcept : tinystl::avl_node(), mValue(value) {}
+
+  constexpr bool operator<(const IntElement &rhs) const noexcept {
+    return mValue < rhs.mValue;
+  }
+};
+
+constexpr const int maxn = 1000000;
+
+IntElement elements[maxn];
+
+class MutexTree {
+public:
+  /// Per-thread state.
+  struct local {
+    explicit local(MutexTree &) noexcept {}
+  };
+
+  MutexTree() {
+    for (int i = 0; i < maxn; i += 2)
+      mTree.insert_unique(&elements[i]);
+  }
+
+  ~MutexTree() { mTree.clear([](IntElement *) {}); }
+
+  bool find(local &, int64_t key) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mTree.find(elements[key]) != nullptr;
+  }
+
+  bool insert(local &, int64_t key) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mTree.insert_unique(&elements[key]);
+  }
+
+  bool erase(local &, int64_t key) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    IntElement *node = mTree.find(elements[key]);
+    if (node != nullptr)
+      mTree.erase(node);
+    return node != nullptr;
+  }
+
+private:
+  tinystl::avl_tree<IntElement> mTree;
+  std::mutex                    mMutex;
+};
+
+class ConcurrentTree {
+public:
+  struct local {
+    explicit local(ConcurrentTree &tree) : participant(tree.mTree.domain()) {}
+
+    tinystl::epoch_participant participant;
+  };
+
+  ConcurrentTree() {
+    tinystl::epoch_participant participant(mTree.domain());
+    for (int i = 0; i < maxn; i += 2)
+      mTree.insert_unique(participant, i, &elements[i]);
+  }
+
+  bool find(local &l, int64_t key) {
+    tinystl::epoch_guard guard(l.participant);
+    return mTree.find(guard, key) != nullptr;
+  }
+
+  bool insert(local &l, int64_t key) {
+    return mTree.insert_unique(l.participant, key, &elements[key]);
+  }
+
+  bool erase(local &l, int64_t key) { return mTree.erase(l.participant, key) != nullptr; }
+
+private:
+  tinystl::concurrent_avl_tree<int64_t, IntElement> mTree;
+};
+
+template <class Tree>
+void run_mix(const char *name, unsigned threads) {
+  Tree tree;
+
+  std::atomic<bool>     stop{false};
+  std::atomic<uint64_t> operations{0};
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back([&, i] {
+      typename Tree::local local(tree);
+      std::mt19937         random(i);
+      uint64_t             count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        uint32_t r   = random();
+        int64_t  key = r % maxn;
+        switch ((r / maxn) % 4) {
+        case 0:
+          tree.insert(local, key);
+          break;
+        case 1:
+          tree.erase(local, key);
+          break;
+        default:
+          tree.find(local, key);
+          break;
+        }
+        count += 1;
+      }
+      operations.fetch_add(count);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  stop.store(true);
+  for (auto &worker : workers)
+    worker.join();
+
+  std::cout << name << " " << threads << " threads: " << operations.load() << " ops/s\n";
+}
+
+int main() {
+  for (int i = 0; i < maxn; ++i)
+    elements[i] = i;
+
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads)) {
+    run_mix<MutexTree>("avl_tree + std::mutex", threads);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    run_mix<ConcurrentTree>("concurrent_avl_tree", threads);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    if (threads == max_threads)
+      break;
+  }
+
+  return 0;
+}
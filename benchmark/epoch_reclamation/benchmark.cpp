@@ -0,0 +1,83 @@
+///
+/// 测试epoch_domain的退休与回收吞吐量
+///
+/// 线程数从1增加到硬件线程数，每个线程持续1秒：
+/// 1. 不断进入并离开临界区，统计pin的吞吐量；
+/// 2. 不断分配节点并立即delete，作为对比的基准；
+/// 3. 不断分配节点并调用retire()，由epoch_domain延迟释放，统计吞吐量以及结束时尚未回收的节点数。
+///
+
+#include "tinystl/epoch_reclamation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+struct Node {
+  int64_t mValue = 0;
+  Node   *mLeft  = nullptr;
+  Node   *mRight = nullptr;
+};
+
+template <class Loop>
+void run(const char *name, unsigned threads, Loop &&loop) {
+  tinystl::epoch_domain domain;
+
+  std::atomic<bool>     stop{false};
+  std::atomic<uint64_t> operations{0};
+  std::atomic<uint64_t> pending{0};
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back([&] {
+      tinystl::epoch_participant local(domain);
+      uint64_t                   count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        loop(local);
+        count += 1;
+      }
+      operations.fetch_add(count);
+      pending.fetch_add(local.pending());
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  stop.store(true);
+  for (auto &worker : workers)
+    worker.join();
+
+  std::cout
+      << name << " " << threads << " threads: " << operations.load() << " ops/s, "
+      << pending.load() << " pending\n";
+}
+
+int main() {
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads)) {
+    run("epoch_guard", threads, [](tinystl::epoch_participant &local) {
+      tinystl::epoch_guard guard(local);
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    run("new + delete", threads, [](tinystl::epoch_participant &) {
+      Node *volatile node = new Node;
+      delete node;
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    run("new + retire", threads, [](tinystl::epoch_participant &local) {
+      local.retire(new Node);
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    if (threads == max_threads)
+      break;
+  }
+
+  return 0;
+}
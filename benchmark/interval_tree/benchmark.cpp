@@ -0,0 +1,107 @@
+///
+/// 测试interval_tree的区间重叠查询与点查询
+///
+/// 共1,000,000个区间，起点在[0, 1,000,000,000)内随机分布，长度在[1, 100,000)内随机分布，
+/// 模拟租约、预约等时间段。分别使用interval_tree与线性扫描数组回答1,000个重叠查询与点查询，
+/// 对比两者的耗时。两种方法得到的结果数量应当相同。
+///
+
+#include "tinystl/interval_tree.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+struct Lease : public tinystl::interval_node<int64_t> {
+  using tinystl::interval_node<int64_t>::interval_node;
+};
+
+constexpr const int     maxn    = 1000000;
+constexpr const int     queries = 1000;
+constexpr const int64_t range   = 1000000000;
+constexpr const int64_t length  = 100000;
+
+Lease leases[maxn];
+
+int64_t random_key(int64_t bound) noexcept {
+  return (int64_t(rand()) * RAND_MAX + rand()) % bound;
+}
+
+template <class Query>
+void run_query(const char *name, const std::vector<int64_t> &points, Query &&query) {
+  size_t found = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  for (int64_t point : points) {
+    found += query(point);
+  }
+
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << name << " " << points.size() << " queries on " << maxn << " intervals (" << found
+      << " found): "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << "ms\n";
+}
+
+int main() {
+  srand(time(nullptr));
+
+  tinystl::interval_tree<Lease> tree;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (auto &lease : leases) {
+    int64_t begin = random_key(range);
+    lease.assign(begin, begin + 1 + random_key(length - 1));
+    tree.insert(&lease);
+  }
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << "interval_tree insert " << maxn << " intervals: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << "ms\n";
+
+  std::vector<int64_t> points(queries);
+  for (auto &point : points) {
+    point = random_key(range);
+  }
+
+  // Overlap queries with a window as long as an average interval.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_query("interval_tree find_overlapping", points, [&](int64_t lo) {
+    size_t count = 0;
+    tree.find_overlapping(lo, lo + length / 2, [&](Lease &) { ++count; });
+    return count;
+  });
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_query("linear scan overlapping", points, [&](int64_t lo) {
+    size_t count = 0;
+    for (const auto &lease : leases) {
+      count += (lease.start() < lo + length / 2 && lo < lease.end()) ? 1 : 0;
+    }
+    return count;
+  });
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_query("interval_tree find_stabbing", points, [&](int64_t point) {
+    return tree.count_stabbing(point);
+  });
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_query("linear scan stabbing", points, [&](int64_t point) {
+    size_t count = 0;
+    for (const auto &lease : leases) {
+      count += (lease.start() <= point && point < lease.end()) ? 1 : 0;
+    }
+    return count;
+  });
+
+  tree.clear([](Lease *p) { p->assign(0, 0); });
+  return 0;
+}
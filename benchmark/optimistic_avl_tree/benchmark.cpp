@@ -0,0 +1,196 @@
+///
+/// 测试optimistic_avl_tree在读多写少场景下的可扩展性
+///
+/// 树中共1,000,000个节点。一个写线程不断用新分配的节点替换随机节点，每次更新后暂停10微秒，模拟读多写少
+/// 的负载。读线程数从1增加到硬件线程数，每个读线程不断查找随机节点，持续1秒后统计读写吞吐量。
+/// 对比使用std::mutex保护、使用std::shared_timed_mutex保护的avl_tree与optimistic_avl_tree。
+/// 前两者在写锁内立即释放被替换的节点，optimistic_avl_tree的读者通过epoch_guard进入临界区，
+/// 被替换的节点交给写线程的epoch_participant延迟回收。
+///
+
+#include "tinystl/optimistic_avl_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+template <class Node>
+struct BasicIntElement : public Node {
+  int64_t mValue = 0;
+
+  constexpr BasicIntElement(int64_t value = 0) noexcept : Node(), mValue(value) {}
+
+  constexpr bool operator<(const BasicIntElement &rhs) const noexcept {
+    return mValue < rhs.mValue;
+  }
+};
+
+using IntElement           = BasicIntElement<tinystl::avl_node>;
+using OptimisticIntElement = BasicIntElement<tinystl::optimistic_avl_node>;
+
+constexpr const int maxn = 1000000;
+
+int64_t keys[maxn];
+
+class MutexTree {
+public:
+  /// Per-thread state.
+  struct local {
+    explicit local(MutexTree &) noexcept {}
+  };
+
+  MutexTree() {
+    for (auto key : keys)
+      mTree.insert_unique(new IntElement(key));
+  }
+
+  ~MutexTree() { mTree.clear([](IntElement *p) { delete p; }); }
+
+  bool contains(local &, int64_t key) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mTree.find(IntElement(key)) != nullptr;
+  }
+
+  void update(local &, int64_t key) {
+    auto                        node = new IntElement(key);
+    std::lock_guard<std::mutex> guard(mMutex);
+    delete mTree.insert_or_replace(node);
+  }
+
+private:
+  tinystl::avl_tree<IntElement> mTree;
+  std::mutex                    mMutex;
+};
+
+class SharedMutexTree {
+public:
+  struct local {
+    explicit local(SharedMutexTree &) noexcept {}
+  };
+
+  SharedMutexTree() {
+    for (auto key : keys)
+      mTree.insert_unique(new IntElement(key));
+  }
+
+  ~SharedMutexTree() { mTree.clear([](IntElement *p) { delete p; }); }
+
+  bool contains(local &, int64_t key) {
+    std::shared_lock<std::shared_timed_mutex> guard(mMutex);
+    return mTree.find(IntElement(key)) != nullptr;
+  }
+
+  void update(local &, int64_t key) {
+    auto                                     node = new IntElement(key);
+    std::lock_guard<std::shared_timed_mutex> guard(mMutex);
+    delete mTree.insert_or_replace(node);
+  }
+
+private:
+  tinystl::avl_tree<IntElement> mTree;
+  std::shared_timed_mutex       mMutex;
+};
+
+class OptimisticTree {
+public:
+  struct local {
+    explicit local(OptimisticTree &tree) : participant(tree.mTree.domain()) {}
+
+    tinystl::epoch_participant participant;
+  };
+
+  OptimisticTree() {
+    for (auto key : keys)
+      mTree.insert_unique(new OptimisticIntElement(key));
+  }
+
+  ~OptimisticTree() {
+    tinystl::epoch_participant participant(mTree.domain());
+    mTree.clear(participant);
+  }
+
+  bool contains(local &l, int64_t key) {
+    tinystl::epoch_guard guard(l.participant);
+    return mTree.contains(guard, OptimisticIntElement(key));
+  }
+
+  void update(local &l, int64_t key) {
+    mTree.insert_or_replace(l.participant, new OptimisticIntElement(key));
+  }
+
+private:
+  tinystl::optimistic_avl_tree<OptimisticIntElement> mTree;
+};
+
+template <class Tree>
+void run_mix(const char *name, unsigned readers) {
+  Tree tree;
+
+  std::atomic<bool>     stop{false};
+  std::atomic<uint64_t> reads{0};
+  uint64_t              writes = 0;
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < readers; ++i) {
+    threads.emplace_back([&, i] {
+      typename Tree::local local(tree);
+      std::mt19937         random(i);
+      uint64_t             count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (!tree.contains(local, keys[random() % maxn])) {
+          fprintf(stderr, "%s lost a node.\n", name);
+          std::abort();
+        }
+        count += 1;
+      }
+      reads.fetch_add(count);
+    });
+  }
+
+  std::thread writer([&] {
+    typename Tree::local local(tree);
+    std::mt19937         random(readers);
+    while (!stop.load(std::memory_order_relaxed)) {
+      tree.update(local, keys[random() % maxn]);
+      writes += 1;
+      std::this_thread::sleep_for(std::chrono::microseconds(10));
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  stop.store(true);
+  for (auto &thread : threads)
+    thread.join();
+  writer.join();
+
+  std::cout
+      << name << " " << readers << " readers: " << reads.load() << " reads/s, " << writes
+      << " writes/s\n";
+}
+
+int main() {
+  for (int i = 0; i < maxn; ++i)
+    keys[i] = int64_t(i) * 2;
+  std::shuffle(std::begin(keys), std::end(keys), std::mt19937(0));
+
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned readers = 1;; readers = std::min(readers * 2, max_threads)) {
+    run_mix<MutexTree>("avl_tree + std::mutex", readers);
+    run_mix<SharedMutexTree>("avl_tree + std::shared_timed_mutex", readers);
+    run_mix<OptimisticTree>("optimistic_avl_tree", readers);
+
+    if (readers == max_threads)
+      break;
+  }
+
+  return 0;
+}
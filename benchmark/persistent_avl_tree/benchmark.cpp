@@ -0,0 +1,166 @@
+///
+/// 测试persistent_avl_tree的更新开销，以及在写入的同时进行一致性扫描的效果
+///
+/// 1. 分别向persistent_avl_tree与std::set插入1,000,000个随机键，再逐个查找与删除，对比耗时。
+///    persistent_avl_tree每次更新都会复制路径上的节点，这部分开销就是获得O(1)快照的代价。
+/// 2. 树中先有1,000,000个键，一个写线程不断插入新的随机键，一个扫描线程不断完整地遍历整棵树，
+///    持续1秒后统计插入与扫描的次数。std::set需要在扫描期间持有互斥锁，写线程因此被阻塞；
+///    persistent_avl_tree的扫描线程只需要取得快照。
+///
+
+#include "tinystl/persistent_avl_tree.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr const int maxn = 1000000;
+
+template <class Func>
+void run_timed(const char *name, Func &&fn) {
+  auto start = std::chrono::high_resolution_clock::now();
+  fn();
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::cout
+      << name << " " << maxn << " keys: "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << "ms\n";
+}
+
+template <class Set>
+void run_updates(const char *name, const std::vector<int64_t> &keys) {
+  Set    set;
+  size_t found = 0;
+
+  std::string prefix(name);
+  run_timed((prefix + " insert").c_str(), [&] {
+    for (int64_t key : keys)
+      set.insert(key);
+  });
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  run_timed((prefix + " find").c_str(), [&] {
+    for (int64_t key : keys)
+      found += (set.find(key) != set.end()) ? 1 : 0;
+  });
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  run_timed((prefix + " erase").c_str(), [&] {
+    for (int64_t key : keys)
+      set.erase(key);
+  });
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  if (found != keys.size())
+    std::cerr << name << " lost keys.\n";
+}
+
+/// std::set adapter with the interface used by run_updates().
+class PersistentSet {
+public:
+  void insert(int64_t key) { mTree.insert_unique(key); }
+  void erase(int64_t key) { mTree.erase(key); }
+
+  const int64_t *find(int64_t key) const { return mTree.find(key); }
+  const int64_t *end() const { return nullptr; }
+
+private:
+  tinystl::persistent_avl_tree<int64_t> mTree;
+};
+
+class LockedSet {
+public:
+  void insert(int64_t key) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    mSet.insert(key);
+  }
+
+  int64_t scan() {
+    std::lock_guard<std::mutex> guard(mMutex);
+    int64_t                     sum = 0;
+    for (int64_t key : mSet)
+      sum += key;
+    return sum;
+  }
+
+private:
+  std::set<int64_t> mSet;
+  std::mutex        mMutex;
+};
+
+class SnapshotSet {
+public:
+  void insert(int64_t key) { mTree.insert_unique(key); }
+
+  int64_t scan() {
+    auto    snapshot = mTree.snapshot();
+    int64_t sum      = 0;
+    for (int64_t key : snapshot)
+      sum += key;
+    return sum;
+  }
+
+private:
+  tinystl::persistent_avl_tree<int64_t> mTree;
+};
+
+template <class Set>
+void run_ingest(const char *name) {
+  Set          set;
+  std::mt19937 random(0);
+  for (int i = 0; i < maxn; ++i)
+    set.insert(random());
+
+  std::atomic<bool> stop{false};
+  uint64_t          inserts = 0;
+  uint64_t          scans   = 0;
+  int64_t           sum     = 0;
+
+  std::thread writer([&] {
+    std::mt19937 random(1);
+    while (!stop.load(std::memory_order_relaxed)) {
+      set.insert(random());
+      inserts += 1;
+    }
+  });
+
+  std::thread scanner([&] {
+    while (!stop.load(std::memory_order_relaxed)) {
+      sum += set.scan();
+      scans += 1;
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  stop.store(true);
+  writer.join();
+  scanner.join();
+
+  std::cout
+      << name << " with concurrent scans: " << inserts << " inserts/s, " << scans
+      << " full scans/s\n";
+}
+
+int main() {
+  std::vector<int64_t> keys(maxn);
+  std::mt19937_64      random(0);
+  for (auto &key : keys)
+    key = static_cast<int64_t>(random());
+
+  run_updates<std::set<int64_t>>("std::set", keys);
+  run_updates<PersistentSet>("persistent_avl_tree", keys);
+
+  run_ingest<LockedSet>("std::set + std::mutex");
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  run_ingest<SnapshotSet>("persistent_avl_tree + snapshot()");
+
+  return 0;
+}
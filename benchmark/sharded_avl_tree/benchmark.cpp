@@ -0,0 +1,204 @@
+///
+/// 测试sharded_avl_tree在写多场景下的可扩展性与在线调整分片边界的耗时
+///
+/// 键的范围为[0, 1,000,000)，开始时树中有一半的键。每个线程不断随机选择一个键，以50%的概率查找，
+/// 25%的概率插入，25%的概率删除，持续1秒后统计吞吐量。线程数从1增加到硬件线程数，多于核数的
+/// 线程只会互相抢占，不能说明可扩展性。对比使用std::mutex保护的avl_tree与64个分片的
+/// sharded_avl_tree，后者的分片边界只保存int64_t键。
+///
+/// 之后将所有分片边界设为0，使所有节点都落在最后一个分片中，测试rebalance()将其均匀分配到各个
+/// 分片的耗时。
+///
+
+#include "tinystl/sharded_avl_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct IntElement : public tinystl::avl_node {
+  int64_t mValue = 0;
+
+  constexpr IntElement(int64_t value = 0) noexcept : tinystl::avl_node(), mValue(value) {}
+
+  constexpr bool operator<(const IntElement &rhs) const noexcept {
+    return mValue < rhs.mValue;
+  }
+};
+
+/// Boundaries of sharded_avl_tree are plain keys.
+struct ElementKey {
+  int64_t operator()(const IntElement &element) const noexcept { return element.mValue; }
+};
+
+struct ElementCompare {
+  using is_transparent = void;
+
+  static int64_t key(const IntElement &element) noexcept { return element.mValue; }
+  static int64_t key(int64_t value) noexcept { return value; }
+
+  template <class L, class R>
+  bool operator()(const L &lhs, const R &rhs) const noexcept {
+    return key(lhs) < key(rhs);
+  }
+};
+
+using ShardedIntTree = tinystl::sharded_avl_tree<IntElement, ElementCompare, tinystl::avl_node,
+                                                 ElementKey>;
+
+constexpr const int maxn   = 1000000;
+constexpr const int shards = 64;
+
+IntElement elements[maxn];
+
+class MutexTree {
+public:
+  MutexTree() {
+    for (int i = 0; i < maxn; i += 2)
+      mTree.insert_unique(&elements[i]);
+  }
+
+  ~MutexTree() { mTree.clear([](IntElement *) {}); }
+
+  bool find(int64_t key) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mTree.find(elements[key]) != nullptr;
+  }
+
+  bool insert(int64_t key) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mTree.insert_unique(&elements[key]);
+  }
+
+  bool erase(int64_t key) {
+    std::lock_guard<std::mutex> guard(mMutex);
+    IntElement *node = mTree.find(elements[key]);
+    if (node != nullptr)
+      mTree.erase(node);
+    return node != nullptr;
+  }
+
+private:
+  tinystl::avl_tree<IntElement> mTree;
+  std::mutex                    mMutex;
+};
+
+std::vector<int64_t> even_bounds() {
+  std::vector<int64_t> bounds;
+  for (int i = 1; i < shards; ++i)
+    bounds.push_back(int64_t(maxn) * i / shards);
+  return bounds;
+}
+
+class ShardedTree {
+public:
+  ShardedTree() : mBounds(even_bounds()), mTree(mBounds.begin(), mBounds.end()) {
+    for (int i = 0; i < maxn; i += 2)
+      mTree.insert_unique(&elements[i]);
+  }
+
+  ~ShardedTree() { mTree.clear([](IntElement *) {}); }
+
+  bool find(int64_t key) { return mTree.contains(key); }
+  bool insert(int64_t key) { return mTree.insert_unique(&elements[key]); }
+
+  bool erase(int64_t key) {
+    if (!mTree.contains(key))
+      return false;
+    mTree.erase(&elements[key]);
+    return true;
+  }
+
+private:
+  std::vector<int64_t> mBounds;
+  ShardedIntTree       mTree;
+};
+
+template <class Tree>
+void run_mix(const char *name, unsigned threads) {
+  Tree tree;
+
+  std::atomic<bool>     stop{false};
+  std::atomic<uint64_t> operations{0};
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back([&, i] {
+      std::mt19937 random(i);
+      uint64_t     count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        uint32_t r   = random();
+        int64_t  key = r % maxn;
+        switch ((r / maxn) % 4) {
+        case 0:
+          tree.insert(key);
+          break;
+        case 1:
+          tree.erase(key);
+          break;
+        default:
+          tree.find(key);
+          break;
+        }
+        count += 1;
+      }
+      operations.fetch_add(count);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  stop.store(true);
+  for (auto &worker : workers)
+    worker.join();
+
+  std::cout << name << " " << threads << " threads: " << operations.load() << " ops/s\n";
+}
+
+void run_rebalance() {
+  std::vector<int64_t> bounds(shards - 1, 0);
+  ShardedIntTree       tree(bounds.begin(), bounds.end());
+  for (auto &element : elements)
+    tree.insert_unique(&element);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  tree.rebalance();
+  auto period = std::chrono::high_resolution_clock::now() - start;
+
+  std::vector<size_t> sizes;
+  for (int i = 0; i < shards; ++i)
+    sizes.push_back(tree.shard_size(i));
+  auto range = std::minmax_element(sizes.begin(), sizes.end());
+  std::cout
+      << "sharded_avl_tree rebalance " << maxn << " nodes into " << shards << " shards ("
+      << *range.first << " to " << *range.second << " nodes per shard): "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(period).count()
+      << "ms\n";
+
+  tree.clear([](IntElement *) {});
+}
+
+int main() {
+  for (int i = 0; i < maxn; ++i)
+    elements[i] = i;
+
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads)) {
+    run_mix<MutexTree>("avl_tree + std::mutex", threads);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    run_mix<ShardedTree>("sharded_avl_tree", threads);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    if (threads == max_threads)
+      break;
+  }
+
+  run_rebalance();
+  return 0;
+}
@@ -0,0 +1,737 @@
+/// 无父节点指针的侵入式AVL Tree。
+///
+/// avl_parentless_node只保存左右子节点指针与子树高度，在64位平台上比avl_node小8字节，并且旋转时
+/// 不需要维护父节点指针。由于没有父节点指针，插入与删除时会在栈上记录从根节点到目标节点的路径，
+/// 然后沿着路径自底向上进行再平衡；迭代器同样携带一个固定深度的路径栈。AVL Tree的高度不超过
+/// 1.44log(n)，因此路径栈的深度有固定的上限。
+///
+/// 与avl_tree一样，实现中没有使用任何堆内存分配。适用于读多写少的大规模集合。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// class MyClass : public tinystl::avl_parentless_node {
+///   Implement MyClass here.
+/// };
+///
+/// tinystl::avl_parentless_tree<MyClass> tree;
+/// ```
+///
+/// 注意，迭代器中保存了完整的路径栈（64位平台上约800字节），应当避免频繁拷贝迭代器。
+///
+
+#ifndef TINYSTL_AVL_PARENTLESS_TREE_H
+#define TINYSTL_AVL_PARENTLESS_TREE_H
+
+#include <tinystl/avl_tree.h>
+#include <tinystl/compressed_pair.h>
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+namespace tinystl {
+
+template <class T, class Compare>
+class avl_parentless_tree;
+
+class avl_parentless_node {
+public:
+  using size_type     = size_t;
+  using pointer       = avl_parentless_node *;
+  using const_pointer = const avl_parentless_node *;
+
+  /// Upper bound of height of any AVL tree that fits in memory. Height of an AVL tree with n nodes
+  /// is less than 1.44 * log2(n + 2).
+  static constexpr size_type max_height = sizeof(void *) * CHAR_BIT * 3 / 2;
+
+  constexpr avl_parentless_node() noexcept = default;
+
+  pointer   left() const noexcept { return mLeft; }
+  pointer   right() const noexcept { return mRight; }
+  size_type height() const noexcept { return mHeight; }
+
+  /// Height of right subtree minus height of left subtree.
+  int balance() const noexcept {
+    return static_cast<int>(height_of(right())) - static_cast<int>(height_of(left()));
+  }
+
+  template <class T, class Compare>
+  friend class avl_parentless_tree;
+
+protected:
+  // avl_parentless_node is NOT a virtual class.
+  // DO NOT cast to avl_parentless_node before destructing.
+  ~avl_parentless_node() = default;
+
+private:
+  static size_type height_of(const_pointer node) noexcept {
+    return (node == nullptr) ? 0 : node->height();
+  }
+
+  void update_height() noexcept {
+    mHeight = static_cast<std::uint8_t>(std::max(height_of(left()), height_of(right())) + 1);
+  }
+
+  pointer rotate_left() noexcept;
+  pointer rotate_right() noexcept;
+
+  /// Update height of this node and rotate if this node is unbalanced. Return the new root of this
+  /// subtree.
+  pointer rebalance() noexcept;
+
+private:
+  avl_parentless_node *mLeft   = nullptr;
+  avl_parentless_node *mRight  = nullptr;
+  std::uint8_t         mHeight = 0;
+};
+
+namespace avl_parentless_tree_detail {
+
+/// Path from root to current node. Only the first depth() slots are initialized.
+template <class NodePtr>
+class path_stack {
+public:
+  using size_type = size_t;
+
+  static constexpr size_type capacity = avl_parentless_node::max_height;
+
+  path_stack() noexcept = default;
+
+  path_stack(const path_stack &other) noexcept : mDepth(other.mDepth) {
+    std::copy(other.mNodes, other.mNodes + mDepth, mNodes);
+  }
+
+  path_stack &operator=(const path_stack &other) noexcept {
+    mDepth = other.mDepth;
+    std::copy(other.mNodes, other.mNodes + mDepth, mNodes);
+    return (*this);
+  }
+
+  size_type depth() const noexcept { return mDepth; }
+  bool      empty() const noexcept { return mDepth == 0; }
+
+  NodePtr top() const noexcept { return (mDepth == 0) ? nullptr : mNodes[mDepth - 1]; }
+
+  NodePtr &operator[](size_type i) noexcept { return mNodes[i]; }
+  NodePtr  operator[](size_type i) const noexcept { return mNodes[i]; }
+
+  void push(NodePtr node) noexcept {
+    assert(mDepth < capacity);
+    mNodes[mDepth++] = node;
+  }
+
+  NodePtr pop() noexcept {
+    assert(mDepth > 0);
+    return mNodes[--mDepth];
+  }
+
+  void resize(size_type depth) noexcept {
+    assert(depth <= mDepth);
+    mDepth = depth;
+  }
+
+  void clear() noexcept { mDepth = 0; }
+
+  void push_leftmost(NodePtr node) noexcept {
+    for (; node != nullptr; node = node->left())
+      push(node);
+  }
+
+  void push_rightmost(NodePtr node) noexcept {
+    for (; node != nullptr; node = node->right())
+      push(node);
+  }
+
+  /// Move to the next node in order. The path becomes empty after the last node.
+  void increment() noexcept {
+    NodePtr node = top();
+    if (node == nullptr)
+      return;
+
+    if (node->right() != nullptr) {
+      push_leftmost(node->right());
+      return;
+    }
+
+    for (;;) {
+      NodePtr child = pop();
+      if (mDepth == 0 || top()->left() == child)
+        return;
+    }
+  }
+
+  /// Move to the previous node in order. Move to the last node if the path is empty.
+  void decrement(NodePtr root) noexcept {
+    NodePtr node = top();
+    if (node == nullptr) {
+      push_rightmost(root);
+      return;
+    }
+
+    if (node->left() != nullptr) {
+      push_rightmost(node->left());
+      return;
+    }
+
+    for (;;) {
+      NodePtr child = pop();
+      if (mDepth == 0 || top()->right() == child)
+        return;
+    }
+  }
+
+private:
+  size_type mDepth = 0;
+  NodePtr   mNodes[capacity];
+};
+
+} // namespace avl_parentless_tree_detail
+
+template <class T, class Compare>
+class avl_parentless_tree_iterator {
+public:
+  using value_type        = T;
+  using reference         = value_type &;
+  using const_reference   = const value_type &;
+  using pointer           = T *;
+  using const_pointer     = const T *;
+  using difference_type   = std::ptrdiff_t;
+  using iterator_category = std::bidirectional_iterator_tag;
+
+  avl_parentless_tree_iterator(avl_parentless_tree<T, Compare> *tree = nullptr) noexcept
+      : mTree(tree) {}
+
+  avl_parentless_tree_iterator &operator++() noexcept {
+    mPath.increment();
+    return (*this);
+  }
+
+  avl_parentless_tree_iterator operator++(int) noexcept {
+    avl_parentless_tree_iterator ret = (*this);
+    ++(*this);
+    return ret;
+  }
+
+  avl_parentless_tree_iterator &operator--() noexcept {
+    mPath.decrement(mTree->root());
+    return (*this);
+  }
+
+  avl_parentless_tree_iterator operator--(int) noexcept {
+    avl_parentless_tree_iterator ret = (*this);
+    --(*this);
+    return ret;
+  }
+
+  reference       operator*() noexcept { return *get(); }
+  const_reference operator*() const noexcept { return *get(); }
+
+  pointer       operator->() noexcept { return get(); }
+  const_pointer operator->() const noexcept { return get(); }
+
+  bool operator==(const avl_parentless_tree_iterator &rhs) const noexcept {
+    return (mTree == rhs.mTree && mPath.top() == rhs.mPath.top());
+  }
+
+  bool operator!=(const avl_parentless_tree_iterator &rhs) const noexcept {
+    return !((*this) == rhs);
+  }
+
+  pointer get() const noexcept { return static_cast<pointer>(mPath.top()); }
+
+  friend class avl_parentless_tree<T, Compare>;
+
+private:
+  avl_parentless_tree<T, Compare>                               *mTree = nullptr;
+  avl_parentless_tree_detail::path_stack<avl_parentless_node *> mPath;
+};
+
+template <class T, class Compare>
+class avl_parentless_tree_const_iterator {
+public:
+  using value_type        = const T;
+  using reference         = const value_type &;
+  using const_reference   = const value_type &;
+  using pointer           = const T *;
+  using const_pointer     = const T *;
+  using difference_type   = std::ptrdiff_t;
+  using iterator_category = std::bidirectional_iterator_tag;
+
+  avl_parentless_tree_const_iterator(const avl_parentless_tree<T, Compare> *tree = nullptr) noexcept
+      : mTree(tree) {}
+
+  avl_parentless_tree_const_iterator &operator++() noexcept {
+    mPath.increment();
+    return (*this);
+  }
+
+  avl_parentless_tree_const_iterator operator++(int) noexcept {
+    avl_parentless_tree_const_iterator ret = (*this);
+    ++(*this);
+    return ret;
+  }
+
+  avl_parentless_tree_const_iterator &operator--() noexcept {
+    mPath.decrement(mTree->root());
+    return (*this);
+  }
+
+  avl_parentless_tree_const_iterator operator--(int) noexcept {
+    avl_parentless_tree_const_iterator ret = (*this);
+    --(*this);
+    return ret;
+  }
+
+  reference       operator*() noexcept { return *get(); }
+  const_reference operator*() const noexcept { return *get(); }
+
+  pointer       operator->() noexcept { return get(); }
+  const_pointer operator->() const noexcept { return get(); }
+
+  bool operator==(const avl_parentless_tree_const_iterator &rhs) const noexcept {
+    return (mTree == rhs.mTree && mPath.top() == rhs.mPath.top());
+  }
+
+  bool operator!=(const avl_parentless_tree_const_iterator &rhs) const noexcept {
+    return !((*this) == rhs);
+  }
+
+  const_pointer get() const noexcept { return static_cast<const_pointer>(mPath.top()); }
+
+  friend class avl_parentless_tree<T, Compare>;
+
+private:
+  const avl_parentless_tree<T, Compare>                               *mTree = nullptr;
+  avl_parentless_tree_detail::path_stack<const avl_parentless_node *> mPath;
+};
+
+template <class T, class Compare = std::less<T>>
+class avl_parentless_tree {
+public:
+  using key_type        = T;
+  using value_type      = T;
+  using reference       = value_type &;
+  using const_reference = const value_type &;
+  using size_type       = size_t;
+  using difference_type = ptrdiff_t;
+  using key_compare     = Compare;
+  using value_compare   = Compare;
+  using pointer         = value_type *;
+  using const_pointer   = const value_type *;
+  using iterator        = avl_parentless_tree_iterator<T, Compare>;
+  using const_iterator  = avl_parentless_tree_const_iterator<T, Compare>;
+
+  static_assert(std::is_base_of<avl_parentless_node, T>::value,
+                "T should inhert from avl_parentless_node.");
+
+  /// Same as avl_tree::is_three_way.
+  static constexpr bool is_three_way =
+      avl_tree_detail::is_three_way_compare<Compare, value_type, value_type>::value;
+
+  avl_parentless_tree() noexcept(std::is_nothrow_default_constructible<Compare>::value)
+      : mValue(nullptr, Compare()) {}
+
+  explicit avl_parentless_tree(const Compare &cmp) noexcept(
+      std::is_nothrow_copy_constructible<Compare>::value)
+      : mValue(nullptr, cmp) {}
+
+  avl_parentless_tree(const avl_parentless_tree &other) = default;
+  avl_parentless_tree &operator=(const avl_parentless_tree &other) = default;
+
+  bool      empty() const noexcept { return mSize == 0; }
+  size_type size() const noexcept { return mSize; }
+
+  pointer root() noexcept { return static_cast<pointer>(mValue.first()); }
+
+  const_pointer root() const noexcept { return static_cast<const_pointer>(mValue.first()); }
+
+  iterator begin() noexcept {
+    iterator it(this);
+    it.mPath.push_leftmost(mValue.first());
+    return it;
+  }
+
+  const_iterator begin() const noexcept {
+    const_iterator it(this);
+    it.mPath.push_leftmost(mValue.first());
+    return it;
+  }
+
+  iterator       end() noexcept { return iterator(this); }
+  const_iterator end() const noexcept { return const_iterator(this); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+
+  /// Return false if there is already a node equal to current one.
+  bool insert_unique(pointer node) noexcept;
+
+  void insert_multi(pointer node) noexcept;
+
+  /// Make sure that node belongs to current tree. Since there is no parent pointer, the path to
+  /// node is searched with the comparator first.
+  void erase(pointer node) noexcept;
+
+  /// Erase the node that iterator points to without searching.
+  void erase(iterator node) noexcept {
+    assert(node.mTree == this);
+    assert(!node.mPath.empty());
+    erase_path(node.mPath);
+  }
+
+  template <class Func>
+  void clear(Func &&handler);
+
+  pointer       find(const_reference value) noexcept;
+  const_pointer find(const_reference value) const noexcept;
+
+  /// Return iterator to the first node that is not less than value.
+  iterator       lower_bound(const_reference value) noexcept;
+  const_iterator lower_bound(const_reference value) const noexcept;
+
+  /// Return iterator to the first node that is greater than value.
+  iterator       upper_bound(const_reference value) noexcept;
+  const_iterator upper_bound(const_reference value) const noexcept;
+
+  key_compare   key_comp() const noexcept { return mValue.second(); }
+  value_compare value_comp() const noexcept { return mValue.second(); }
+
+private:
+  using node_pointer = avl_parentless_node *;
+  using path_type    = avl_parentless_tree_detail::path_stack<node_pointer>;
+
+  template <class L, class R>
+  int compare(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::compare(
+        mValue.second(), lhs, rhs, std::integral_constant<bool, is_three_way>());
+  }
+
+  template <class L, class R>
+  bool less(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::less(
+        mValue.second(), lhs, rhs, std::integral_constant<bool, is_three_way>());
+  }
+
+  /// Replace path[i] with node in the parent of path[i].
+  void relink(path_type &path, size_type i, node_pointer node) noexcept;
+
+  /// Link node as a child of path.top() and rebalance along path.
+  void insert_leaf(path_type &path, node_pointer node, bool left) noexcept;
+
+  /// Erase path.top() from the tree.
+  void erase_path(path_type &path) noexcept;
+
+  /// Rebalance nodes in path from bottom to top.
+  void retrace(path_type &path) noexcept;
+
+  /// Fill path with nodes from root to lower bound of value. Path is empty if there is no such
+  /// node.
+  template <class NodePtr>
+  void lower_bound_path(const_reference                                  value,
+                        avl_parentless_tree_detail::path_stack<NodePtr> &path) const noexcept;
+  template <class NodePtr>
+  void upper_bound_path(const_reference                                  value,
+                        avl_parentless_tree_detail::path_stack<NodePtr> &path) const noexcept;
+
+  template <class Func>
+  void clear_impl(node_pointer node, Func &handler);
+
+private:
+  size_type                                       mSize = 0;
+  compressed_pair<avl_parentless_node *, Compare> mValue;
+};
+
+inline auto avl_parentless_node::rotate_left() noexcept -> pointer {
+  assert(right() != nullptr);
+
+  pointer r = right();
+  mRight    = r->left();
+  r->mLeft  = this;
+
+  update_height();
+  r->update_height();
+  return r;
+}
+
+inline auto avl_parentless_node::rotate_right() noexcept -> pointer {
+  assert(left() != nullptr);
+
+  pointer l = left();
+  mLeft     = l->right();
+  l->mRight = this;
+
+  update_height();
+  l->update_height();
+  return l;
+}
+
+inline auto avl_parentless_node::rebalance() noexcept -> pointer {
+  size_type hl = height_of(left());
+  size_type hr = height_of(right());
+
+  if (hl > hr + 1) {
+    if (left()->balance() > 0)
+      mLeft = left()->rotate_left();
+    return rotate_right();
+  } else if (hr > hl + 1) {
+    if (right()->balance() < 0)
+      mRight = right()->rotate_right();
+    return rotate_left();
+  }
+
+  update_height();
+  return this;
+}
+
+template <class T, class Compare>
+void avl_parentless_tree<T, Compare>::relink(path_type   &path,
+                                             size_type    i,
+                                             node_pointer node) noexcept {
+  if (i == 0) {
+    mValue.first() = node;
+  } else {
+    node_pointer parent = path[i - 1];
+    if (parent->left() == path[i])
+      parent->mLeft = node;
+    else
+      parent->mRight = node;
+  }
+}
+
+template <class T, class Compare>
+void avl_parentless_tree<T, Compare>::insert_leaf(path_type   &path,
+                                                  node_pointer node,
+                                                  bool         left) noexcept {
+  node->mLeft = node->mRight = nullptr;
+  node->mHeight              = 1;
+
+  node_pointer parent = path.top();
+  if (parent == nullptr)
+    mValue.first() = node;
+  else if (left)
+    parent->mLeft = node;
+  else
+    parent->mRight = node;
+
+  retrace(path);
+  mSize += 1;
+}
+
+template <class T, class Compare>
+void avl_parentless_tree<T, Compare>::retrace(path_type &path) noexcept {
+  for (size_type i = path.depth(); i > 0; --i) {
+    node_pointer node   = path[i - 1];
+    size_type    height = node->height();
+    node_pointer root   = node->rebalance();
+
+    if (root != node) {
+      relink(path, i - 1, root);
+      path[i - 1] = root;
+    }
+
+    if (root->height() == height)
+      break;
+  }
+}
+
+template <class T, class Compare>
+bool avl_parentless_tree<T, Compare>::insert_unique(pointer obj) noexcept {
+  path_type    path;
+  node_pointer current = mValue.first();
+  bool         left    = true;
+
+  while (current != nullptr) {
+    int cmp = compare(*obj, *static_cast<pointer>(current));
+    if (cmp == 0)
+      return false;
+
+    path.push(current);
+    left    = (cmp < 0);
+    current = left ? current->left() : current->right();
+  }
+
+  insert_leaf(path, obj, left);
+  return true;
+}
+
+template <class T, class Compare>
+void avl_parentless_tree<T, Compare>::insert_multi(pointer obj) noexcept {
+  path_type    path;
+  node_pointer current = mValue.first();
+  bool         left    = true;
+
+  // Equal nodes are inserted after existing ones.
+  while (current != nullptr) {
+    path.push(current);
+    left    = less(*obj, *static_cast<pointer>(current));
+    current = left ? current->left() : current->right();
+  }
+
+  insert_leaf(path, obj, left);
+}
+
+template <class T, class Compare>
+void avl_parentless_tree<T, Compare>::erase(pointer obj) noexcept {
+  path_type path;
+  lower_bound_path(*obj, path);
+
+  // There may be several nodes equal to obj.
+  while (path.top() != static_cast<node_pointer>(obj)) {
+    assert(!path.empty());
+    path.increment();
+  }
+
+  erase_path(path);
+}
+
+template <class T, class Compare>
+void avl_parentless_tree<T, Compare>::erase_path(path_type &path) noexcept {
+  size_type    i    = path.depth() - 1;
+  node_pointer node = path[i];
+
+  if (node->left() != nullptr && node->right() != nullptr) {
+    // Replace node with its successor.
+    path.push_leftmost(node->right());
+    node_pointer next   = path.pop();
+    node_pointer parent = path.top();
+
+    if (parent == node)
+      node->mRight = next->right();
+    else
+      parent->mLeft = next->right();
+
+    next->mLeft   = node->left();
+    next->mRight  = node->right();
+    next->mHeight = node->mHeight;
+
+    relink(path, i, next);
+    path[i] = next;
+  } else {
+    relink(path, i, (node->left() != nullptr) ? node->left() : node->right());
+    path.pop();
+  }
+
+  retrace(path);
+  mSize -= 1;
+}
+
+template <class T, class Compare>
+template <class Func>
+void avl_parentless_tree<T, Compare>::clear(Func &&handler) {
+  if (mValue.first() != nullptr) {
+    clear_impl(mValue.first(), handler);
+    mValue.first() = nullptr;
+    mSize          = 0;
+  }
+}
+
+template <class T, class Compare>
+template <class Func>
+void avl_parentless_tree<T, Compare>::clear_impl(node_pointer node, Func &handler) {
+  node_pointer left  = node->left();
+  node_pointer right = node->right();
+
+  handler(static_cast<pointer>(node));
+  if (left != nullptr)
+    clear_impl(left, handler);
+  if (right != nullptr)
+    clear_impl(right, handler);
+}
+
+template <class T, class Compare>
+auto avl_parentless_tree<T, Compare>::find(const_reference value) noexcept -> pointer {
+  return const_cast<pointer>(static_cast<const avl_parentless_tree *>(this)->find(value));
+}
+
+template <class T, class Compare>
+auto avl_parentless_tree<T, Compare>::find(const_reference value) const noexcept
+    -> const_pointer {
+  const avl_parentless_node *node = mValue.first();
+  while (node != nullptr) {
+    int cmp = compare(value, *static_cast<const_pointer>(node));
+    if (cmp < 0) {
+      node = node->left();
+    } else if (cmp > 0) {
+      node = node->right();
+    } else {
+      return static_cast<const_pointer>(node);
+    }
+  }
+  return nullptr;
+}
+
+template <class T, class Compare>
+template <class NodePtr>
+void avl_parentless_tree<T, Compare>::lower_bound_path(
+    const_reference value, avl_parentless_tree_detail::path_stack<NodePtr> &path) const noexcept {
+  size_type depth = 0;
+  NodePtr   node  = mValue.first();
+  while (node != nullptr) {
+    path.push(node);
+    if (less(*static_cast<const_pointer>(node), value)) {
+      node = node->right();
+    } else {
+      depth = path.depth();
+      node  = node->left();
+    }
+  }
+  path.resize(depth);
+}
+
+template <class T, class Compare>
+template <class NodePtr>
+void avl_parentless_tree<T, Compare>::upper_bound_path(
+    const_reference value, avl_parentless_tree_detail::path_stack<NodePtr> &path) const noexcept {
+  size_type depth = 0;
+  NodePtr   node  = mValue.first();
+  while (node != nullptr) {
+    path.push(node);
+    if (less(value, *static_cast<const_pointer>(node))) {
+      depth = path.depth();
+      node  = node->left();
+    } else {
+      node = node->right();
+    }
+  }
+  path.resize(depth);
+}
+
+template <class T, class Compare>
+auto avl_parentless_tree<T, Compare>::lower_bound(const_reference value) noexcept -> iterator {
+  iterator it(this);
+  lower_bound_path(value, it.mPath);
+  return it;
+}
+
+template <class T, class Compare>
+auto avl_parentless_tree<T, Compare>::lower_bound(const_reference value) const noexcept
+    -> const_iterator {
+  const_iterator it(this);
+  lower_bound_path(value, it.mPath);
+  return it;
+}
+
+template <class T, class Compare>
+auto avl_parentless_tree<T, Compare>::upper_bound(const_reference value) noexcept -> iterator {
+  iterator it(this);
+  upper_bound_path(value, it.mPath);
+  return it;
+}
+
+template <class T, class Compare>
+auto avl_parentless_tree<T, Compare>::upper_bound(const_reference value) const noexcept
+    -> const_iterator {
+  const_iterator it(this);
+  upper_bound_path(value, it.mPath);
+  return it;
+}
+
+} // namespace tinystl
+
+#endif // TINYSTL_AVL_PARENTLESS_TREE_H
@@ -0,0 +1,141 @@
+/// 基于avl_tree的侵入式序列，以位置作为隐式的键。
+///
+/// 节点之间不进行比较，节点的位置由子树大小推导得到，因此节点需要继承avl_rank_node。插入、删除、
+/// 按下标访问、分裂与拼接的时间复杂度均为O(log n)，平衡操作完全复用avl_tree的实现。适用于需要在
+/// 中间频繁插入删除的大型可编辑缓冲区，此时std::vector的插入与删除需要O(n)时间。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// class Piece : public tinystl::avl_rank_node {
+///   Implement Piece here.
+/// };
+///
+/// tinystl::avl_sequence<Piece> sequence;
+/// sequence.insert(index, &piece);
+/// ```
+///
+
+#ifndef TINYSTL_AVL_SEQUENCE_H
+#define TINYSTL_AVL_SEQUENCE_H
+
+#include <tinystl/avl_tree.h>
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+namespace tinystl {
+
+namespace avl_sequence_detail {
+
+/// All nodes are equivalent, so nodes inserted with a hint stay exactly where they are put.
+template <class T>
+struct position_compare {
+  constexpr bool operator()(const T &, const T &) const noexcept { return false; }
+};
+
+} // namespace avl_sequence_detail
+
+/// Sequence of T ordered by position. T should inherit from avl_rank_node.
+template <class T>
+class avl_sequence {
+public:
+  using value_type      = T;
+  using reference       = value_type &;
+  using const_reference = const value_type &;
+  using size_type       = size_t;
+  using difference_type = ptrdiff_t;
+  using pointer         = value_type *;
+  using const_pointer   = const value_type *;
+  using tree_type       = avl_tree<T, avl_sequence_detail::position_compare<T>, avl_rank_node>;
+  using iterator        = typename tree_type::iterator;
+  using const_iterator  = typename tree_type::const_iterator;
+
+  avl_sequence() noexcept = default;
+
+  bool      empty() const noexcept { return mTree.empty(); }
+  size_type size() const noexcept { return mTree.size(); }
+
+  iterator       begin() noexcept { return mTree.begin(); }
+  const_iterator begin() const noexcept { return mTree.begin(); }
+
+  iterator       end() noexcept { return mTree.end(); }
+  const_iterator end() const noexcept { return mTree.end(); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+
+  reference       front() noexcept { return mTree.front(); }
+  const_reference front() const noexcept { return mTree.front(); }
+  reference       back() noexcept { return mTree.back(); }
+  const_reference back() const noexcept { return mTree.back(); }
+
+  /// Access the node at index in O(log n) time. index should be less than size().
+  reference operator[](size_type index) noexcept {
+    assert(index < size());
+    return *mTree.select(index);
+  }
+
+  const_reference operator[](size_type index) const noexcept {
+    assert(index < size());
+    return *mTree.select(index);
+  }
+
+  /// Index of node in O(log n) time. Make sure that node belongs to current sequence.
+  size_type index_of(const_pointer node) const noexcept { return mTree.index_of(node); }
+
+  /// Insert node before pos.
+  void insert(const_iterator pos, pointer node) noexcept { mTree.insert_multi(pos, node); }
+
+  /// Insert node so that it is at index afterwards. index should not be greater than size().
+  void insert(size_type index, pointer node) noexcept {
+    assert(index <= size());
+    mTree.insert_multi(const_iterator(&mTree, mTree.select(index)), node);
+  }
+
+  void push_front(pointer node) noexcept { mTree.insert_multi(cbegin(), node); }
+  void push_back(pointer node) noexcept { mTree.insert_back_multi(node); }
+
+  /// Make sure that node belongs to current sequence.
+  void erase(pointer node) noexcept { mTree.erase(node); }
+  void erase(iterator node) noexcept { mTree.erase(node); }
+
+  /// Remove the node at index and return it. index should be less than size().
+  pointer erase(size_type index) noexcept {
+    assert(index < size());
+    pointer node = mTree.select(index);
+    mTree.erase(node);
+    return node;
+  }
+
+  pointer pop_front() noexcept { return mTree.pop_front(); }
+  pointer pop_back() noexcept { return mTree.pop_back(); }
+
+  template <class Func>
+  void clear(Func &&handler) {
+    mTree.clear(handler);
+  }
+
+  /// Split this sequence in O(log n) time. The first index nodes go to the first sequence and the
+  /// others go to the second one. This sequence is empty after splitting.
+  std::pair<avl_sequence, avl_sequence> split(size_type index) noexcept {
+    auto trees = mTree.split_first(index);
+    return {avl_sequence(trees.first), avl_sequence(trees.second)};
+  }
+
+  /// Append right to left in O(log n) time and return the new sequence. left and right are empty
+  /// afterwards.
+  static avl_sequence concat(avl_sequence &left, avl_sequence &right) noexcept {
+    return avl_sequence(tree_type::join2(left.mTree, right.mTree));
+  }
+
+private:
+  explicit avl_sequence(const tree_type &tree) noexcept : mTree(tree) {}
+
+  tree_type mTree;
+};
+
+} // namespace tinystl
+
+#endif // TINYSTL_AVL_SEQUENCE_H
@@ -25,22 +25,184 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <iterator>
+#include <memory>
 #include <type_traits>
+#include <utility>
 
 namespace tinystl {
 
-template <class T, class Compare>
+template <class T, class Compare, class Node>
 class avl_tree;
 
-class avl_node {
+template <class T, class Compare, class Node>
+class avl_tree_const_iterator;
+
+namespace avl_tree_detail {
+
+template <class...>
+using void_t = void;
+
+template <class Compare, class L, class R>
+using compare_result_t = decltype(std::declval<const Compare &>()(std::declval<const L &>(),
+                                                                 std::declval<const R &>()));
+
+/// A comparator is three-way if it does not return bool. The result is expected to be an integer
+/// or an ordering type (e.g. std::strong_ordering) that can be compared with literal 0.
+template <class Compare, class L, class R, class = void>
+struct is_three_way_compare : std::false_type {};
+
+template <class Compare, class L, class R>
+struct is_three_way_compare<Compare, L, R, void_t<compare_result_t<Compare, L, R>>>
+    : std::integral_constant<
+          bool,
+          !std::is_same<typename std::decay<compare_result_t<Compare, L, R>>::type, bool>::value> {
+};
+
+/// Three-way comparison with a three-way comparator.
+template <class Compare, class L, class R>
+int compare(const Compare &cmp, const L &lhs, const R &rhs, std::true_type) noexcept {
+  auto result = cmp(lhs, rhs);
+  return (result < 0) ? -1 : ((result > 0) ? 1 : 0);
+}
+
+/// Three-way comparison with a less-than predicate.
+template <class Compare, class L, class R>
+int compare(const Compare &cmp, const L &lhs, const R &rhs, std::false_type) noexcept {
+  if (cmp(lhs, rhs))
+    return -1;
+  if (cmp(rhs, lhs))
+    return 1;
+  return 0;
+}
+
+template <class Compare, class L, class R>
+bool less(const Compare &cmp, const L &lhs, const R &rhs, std::true_type) noexcept {
+  return cmp(lhs, rhs) < 0;
+}
+
+template <class Compare, class L, class R>
+bool less(const Compare &cmp, const L &lhs, const R &rhs, std::false_type) noexcept {
+  return cmp(lhs, rhs);
+}
+
+/// Hint the CPU to load the cache line at ptr. It is a no-op if the compiler has no prefetch
+/// builtin.
+inline void prefetch(const void *ptr) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(ptr);
+#else
+  (void)ptr;
+#endif
+}
+
+template <class NodePtr>
+NodePtr next_node(NodePtr node) noexcept {
+  if (node->right() != nullptr) {
+    node = node->right();
+
+    while (node->left() != nullptr)
+      node = node->left();
+
+    return node;
+  } else {
+    for (;;) {
+      NodePtr last = node;
+      node         = node->parent();
+
+      if (node == nullptr)
+        break;
+
+      if (node->left() == last)
+        break;
+    }
+    return node;
+  }
+}
+
+template <class NodePtr>
+NodePtr prev_node(NodePtr node) noexcept {
+  if (node->left() != nullptr) {
+    node = node->left();
+
+    while (node->right() != nullptr)
+      node = node->right();
+
+    return node;
+  } else {
+    for (;;) {
+      NodePtr last = node;
+      node         = node->parent();
+
+      if (node == nullptr)
+        break;
+
+      if (node->right() == last)
+        break;
+    }
+    return node;
+  }
+}
+
+/// Run both halves of a set operation on the calling thread.
+struct sequential_fork {
+  template <class Tree, class Left, class Right>
+  void operator()(Tree &tree, size_t, Left &&left, Right &&right) const {
+    left(tree, *this);
+    right(tree, *this);
+  }
+};
+
+/// Parallel set operations, see avl_tree_parallel.h.
+template <class Tree>
+struct parallel_set_operations;
+
+// Augmentation policies of basic_avl_node. Aggregates are updated whenever children of a node
+// change, including rotations, rebalancing, splitting and joining.
+
+/// No augmentation.
+class no_augment {};
+
+/// Stores size of the subtree to support order statistics.
+class size_augment {
+public:
+  /// Number of nodes in the subtree.
+  size_t size() const noexcept { return mSize; }
+
+protected:
+  size_t mSize = 1;
+};
+
+/// Whether Node stores subtree size, which enables order statistics.
+template <class Node>
+struct is_ranked_node : std::is_base_of<size_augment, Node> {};
+
+/// Calls T::recompute() to update user-defined aggregates.
+template <class T>
+class user_augment {};
+
+/// Links of basic_avl_node are plain pointers.
+struct plain_link {
+  template <class P>
+  using type = P;
+};
+
+} // namespace avl_tree_detail
+
+/// Default AVL node. Augment decides which aggregate is maintained in each node, see avl_node,
+/// avl_rank_node and avl_augmented_node. Link decides how parent and child pointers are stored,
+/// see optimistic_avl_tree.
+template <class Augment, class Link = avl_tree_detail::plain_link>
+class basic_avl_node : public Augment {
 public:
   using size_type     = size_t;
-  using pointer       = avl_node *;
-  using const_pointer = const avl_node *;
+  using pointer       = basic_avl_node *;
+  using const_pointer = const basic_avl_node *;
+  using link_type     = typename Link::template type<pointer>;
 
-  constexpr avl_node() noexcept = default;
+  constexpr basic_avl_node() noexcept = default;
 
   bool is_left() const noexcept;
   bool is_right() const noexcept;
@@ -50,52 +212,216 @@ public:
   pointer   right() const noexcept { return mRight; }
   size_type height() const noexcept { return mHeight; }
 
-  pointer       next() noexcept;
-  pointer       prev() noexcept;
-  const_pointer next() const noexcept;
-  const_pointer prev() const noexcept;
+  /// Height of right subtree minus height of left subtree.
+  int balance() const noexcept {
+    return static_cast<int>(right() ? right()->height() : 0) -
+           static_cast<int>(left() ? left()->height() : 0);
+  }
+
+  pointer       next() noexcept { return avl_tree_detail::next_node(this); }
+  pointer       prev() noexcept { return avl_tree_detail::prev_node(this); }
+  const_pointer next() const noexcept { return avl_tree_detail::next_node(this); }
+  const_pointer prev() const noexcept { return avl_tree_detail::prev_node(this); }
 
-  template <class T, class Compare>
+  template <class T, class Compare, class Node>
   friend class avl_tree;
 
 protected:
   // avl_node is NOT a virtual class.
   // DO NOT cast to avl_node before destructing.
-  ~avl_node() = default;
+  ~basic_avl_node() = default;
 
 private:
   void update_height() noexcept {
     mHeight = std::max(left() ? left()->height() : size_type(0),
                        right() ? right()->height() : size_type(0)) +
               1;
+    update_augment();
+  }
+
+  static constexpr bool augmented = !std::is_same<Augment, avl_tree_detail::no_augment>::value;
+
+  /// Update aggregate of this node from its children.
+  void update_augment() noexcept { update_augment(static_cast<Augment *>(this)); }
+  void update_augment(avl_tree_detail::no_augment *) noexcept {}
+  void update_augment(avl_tree_detail::size_augment *) noexcept {
+    this->mSize = (left() ? left()->size() : 0) + (right() ? right()->size() : 0) + 1;
+  }
+  template <class T>
+  void update_augment(avl_tree_detail::user_augment<T> *) noexcept {
+    static_cast<T *>(this)->recompute();
+  }
+
+  /// Update aggregates of this node and all its ancestors.
+  void update_path() noexcept { update_path(std::integral_constant<bool, augmented>()); }
+  void update_path(std::false_type) noexcept {}
+  void update_path(std::true_type) noexcept {
+    for (pointer node = this; node != nullptr; node = node->parent())
+      node->update_augment();
+  }
+
+  void set_parent(pointer node) noexcept { mParent = node; }
+  void set_left(pointer node) noexcept { mLeft = node; }
+  void set_right(pointer node) noexcept { mRight = node; }
+
+  /// Reset balance information according to height of left and right subtrees.
+  void reset_balance(size_type left_height, size_type right_height) noexcept {
+    mHeight = std::max(left_height, right_height) + 1;
+    update_augment();
   }
 
-  template <class Impl, class Compare>
-  void replace_as_child(pointer node, pointer parent, avl_tree<Impl, Compare> &tree) noexcept;
-
-  template <class Impl, class Compare>
-  void replace(pointer node, avl_tree<Impl, Compare> &tree) noexcept;
-  template <class Impl, class Compare>
-  pointer rotate_left(avl_tree<Impl, Compare> &tree) noexcept;
-  template <class Impl, class Compare>
-  pointer rotate_right(avl_tree<Impl, Compare> &tree) noexcept;
-  template <class Impl, class Compare>
-  pointer fix_left(avl_tree<Impl, Compare> &tree) noexcept;
-  template <class Impl, class Compare>
-  pointer fix_right(avl_tree<Impl, Compare> &tree) noexcept;
-  template <class Impl, class Compare>
-  void rebalance(avl_tree<Impl, Compare> &tree) noexcept;
-  template <class Impl, class Compare>
-  void fix_insert(avl_tree<Impl, Compare> &tree) noexcept;
+  template <class Tree>
+  void replace_as_child(pointer node, pointer parent, Tree &tree) noexcept;
+
+  template <class Tree>
+  void replace(pointer node, Tree &tree) noexcept;
+  template <class Tree>
+  pointer rotate_left(Tree &tree) noexcept;
+  template <class Tree>
+  pointer rotate_right(Tree &tree) noexcept;
+  template <class Tree>
+  pointer fix_left(Tree &tree) noexcept;
+  template <class Tree>
+  pointer fix_right(Tree &tree) noexcept;
+  template <class Tree>
+  void rebalance(Tree &tree) noexcept;
+  /// Called on a node whose subtree height increased by 1. Return true if height of the whole tree
+  /// increased.
+  template <class Tree>
+  bool fix_growth(Tree &tree) noexcept;
+  template <class Tree>
+  void fix_insert(Tree &tree) noexcept;
+  /// Called on parent of the erased node. left is true if the left subtree of this node shrinked.
+  template <class Tree>
+  void fix_erase(bool left, Tree &tree) noexcept;
 
 private:
-  avl_node *mParent = nullptr;
-  avl_node *mLeft   = nullptr;
-  avl_node *mRight  = nullptr;
+  link_type mParent = nullptr;
+  link_type mLeft   = nullptr;
+  link_type mRight  = nullptr;
   size_type mHeight = 0;
 };
 
-template <class T, class Compare>
+/// Default node, which stores height of the subtree.
+using avl_node = basic_avl_node<avl_tree_detail::no_augment>;
+
+/// Order statistic node. It also stores size of the subtree, so that avl_tree could find the k-th
+/// node and count nodes in a range in O(log n) time. Maintaining sizes costs an extra walk to the
+/// root on every insertion and erasion.
+using avl_rank_node = basic_avl_node<avl_tree_detail::size_augment>;
+
+/// Node with user-defined aggregates. T should inherit from avl_augmented_node<T> and provide a
+/// noexcept recompute() that updates aggregates of the node from its own value and its children.
+/// It is called bottom-up whenever children of a node change.
+///
+/// ```cpp
+/// struct Sample : tinystl::avl_augmented_node<Sample> {
+///   int64_t time, value, sum;
+///
+///   void recompute() noexcept {
+///     sum = value;
+///     if (left() != nullptr)
+///       sum += static_cast<Sample *>(left())->sum;
+///     if (right() != nullptr)
+///       sum += static_cast<Sample *>(right())->sum;
+///   }
+/// };
+///
+/// tinystl::avl_tree<Sample, SampleLess, tinystl::avl_augmented_node<Sample>> tree;
+/// ```
+template <class T>
+using avl_augmented_node = basic_avl_node<avl_tree_detail::user_augment<T>>;
+
+/// Compact AVL node. The balance factor is packed into the low 2 bits of the parent pointer, so the
+/// node header is 3 pointers large (24 bytes on 64-bit platforms) instead of 4. Select it by
+/// inheriting from avl_compact_node and passing it as the Node parameter of avl_tree:
+///
+/// ```cpp
+/// class MyClass : public tinystl::avl_compact_node {};
+/// tinystl::avl_tree<MyClass, std::less<MyClass>, tinystl::avl_compact_node> tree;
+/// ```
+class avl_compact_node {
+public:
+  using pointer       = avl_compact_node *;
+  using const_pointer = const avl_compact_node *;
+  using link_type     = pointer;
+
+  constexpr avl_compact_node() noexcept = default;
+
+  bool is_left() const noexcept { return parent() != nullptr && parent()->left() == this; }
+  bool is_right() const noexcept { return parent() != nullptr && parent()->right() == this; }
+
+  pointer parent() const noexcept { return reinterpret_cast<pointer>(mParent & ~balance_mask); }
+  pointer left() const noexcept { return mLeft; }
+  pointer right() const noexcept { return mRight; }
+
+  /// Height of right subtree minus height of left subtree. Always be one of -1, 0 and 1.
+  int balance() const noexcept { return static_cast<int>(mParent & balance_mask) - 1; }
+
+  pointer       next() noexcept { return avl_tree_detail::next_node(this); }
+  pointer       prev() noexcept { return avl_tree_detail::prev_node(this); }
+  const_pointer next() const noexcept { return avl_tree_detail::next_node(this); }
+  const_pointer prev() const noexcept { return avl_tree_detail::prev_node(this); }
+
+  template <class T, class Compare, class Node>
+  friend class avl_tree;
+
+protected:
+  // avl_compact_node is NOT a virtual class.
+  // DO NOT cast to avl_compact_node before destructing.
+  ~avl_compact_node() = default;
+
+private:
+  static constexpr std::uintptr_t balance_mask = 3;
+
+  void set_parent(pointer node) noexcept {
+    mParent = reinterpret_cast<std::uintptr_t>(node) | (mParent & balance_mask);
+  }
+
+  void set_left(pointer node) noexcept { mLeft = node; }
+  void set_right(pointer node) noexcept { mRight = node; }
+
+  void set_balance(int balance) noexcept {
+    mParent = (mParent & ~balance_mask) | static_cast<std::uintptr_t>(balance + 1);
+  }
+
+  /// Reset balance information according to height of left and right subtrees.
+  void reset_balance(size_t left_height, size_t right_height) noexcept {
+    set_balance(static_cast<int>(right_height) - static_cast<int>(left_height));
+  }
+
+  template <class Tree>
+  void replace_as_child(pointer node, pointer parent, Tree &tree) noexcept;
+
+  template <class Tree>
+  void replace(pointer node, Tree &tree) noexcept;
+  template <class Tree>
+  pointer rotate_left(Tree &tree) noexcept;
+  template <class Tree>
+  pointer rotate_right(Tree &tree) noexcept;
+  template <class Tree>
+  pointer fix_left(Tree &tree) noexcept;
+  template <class Tree>
+  pointer fix_right(Tree &tree) noexcept;
+  /// Called on a node whose subtree height increased by 1. Return true if height of the whole tree
+  /// increased.
+  template <class Tree>
+  bool fix_growth(Tree &tree) noexcept;
+  template <class Tree>
+  void fix_insert(Tree &tree) noexcept;
+  template <class Tree>
+  void fix_erase(bool left, Tree &tree) noexcept;
+
+private:
+  // Parent pointer | (balance + 1).
+  std::uintptr_t    mParent = 1;
+  avl_compact_node *mLeft   = nullptr;
+  avl_compact_node *mRight  = nullptr;
+};
+
+static_assert(alignof(avl_compact_node) >= 4, "Balance factor requires 2 free pointer bits.");
+
+template <class T, class Compare, class Node>
 class avl_tree_iterator {
 public:
   using value_type        = T;
@@ -104,10 +430,15 @@ public:
   using pointer           = T *;
   using const_pointer     = const T *;
   using difference_type   = std::ptrdiff_t;
-  using iterator_category = std::bidirectional_iterator_tag;
 
-  constexpr avl_tree_iterator(avl_tree<T, Compare> *tree = nullptr,
-                              avl_node             *node = nullptr) noexcept
+  /// Iterators of order statistic trees are random access, see avl_rank_node.
+  using iterator_category =
+      typename std::conditional<avl_tree_detail::is_ranked_node<Node>::value,
+                                std::random_access_iterator_tag,
+                                std::bidirectional_iterator_tag>::type;
+
+  constexpr avl_tree_iterator(avl_tree<T, Compare, Node> *tree = nullptr,
+                              Node                       *node = nullptr) noexcept
       : mTree(tree), mPtr(node) {}
 
   constexpr avl_tree_iterator(const avl_tree_iterator &) noexcept = default;
@@ -129,13 +460,7 @@ public:
     if (mPtr != nullptr) {
       mPtr = mPtr->prev();
     } else {
-      mPtr = static_cast<avl_node *>(mTree->root());
-
-      if (mPtr == nullptr)
-        return (*this);
-
-      while (mPtr->right() != nullptr)
-        mPtr = mPtr->right();
+      mPtr = mTree->mRightmost;
     }
     return (*this);
   }
@@ -146,11 +471,49 @@ public:
     return ret;
   }
 
+  // Random access operators below take O(log n) time and are available only if Node is
+  // avl_rank_node.
+
+  avl_tree_iterator &operator+=(difference_type n) noexcept {
+    difference_type target = index() + n;
+    assert(target >= 0 && static_cast<size_t>(target) <= mTree->size());
+    mPtr = mTree->select(static_cast<size_t>(target));
+    return (*this);
+  }
+
+  avl_tree_iterator &operator-=(difference_type n) noexcept { return (*this) += -n; }
+
+  avl_tree_iterator operator+(difference_type n) const noexcept {
+    avl_tree_iterator ret = (*this);
+    return ret += n;
+  }
+
+  avl_tree_iterator operator-(difference_type n) const noexcept {
+    avl_tree_iterator ret = (*this);
+    return ret -= n;
+  }
+
+  friend avl_tree_iterator operator+(difference_type n, const avl_tree_iterator it) noexcept {
+    return it + n;
+  }
+
+  difference_type operator-(const avl_tree_iterator rhs) const noexcept {
+    return index() - rhs.index();
+  }
+
+  reference       operator[](difference_type n) noexcept { return *((*this) + n); }
+  const_reference operator[](difference_type n) const noexcept { return *((*this) + n); }
+
+  bool operator<(const avl_tree_iterator rhs) const noexcept { return index() < rhs.index(); }
+  bool operator>(const avl_tree_iterator rhs) const noexcept { return rhs < (*this); }
+  bool operator<=(const avl_tree_iterator rhs) const noexcept { return !(rhs < (*this)); }
+  bool operator>=(const avl_tree_iterator rhs) const noexcept { return !((*this) < rhs); }
+
   reference       operator*() noexcept { return *static_cast<pointer>(mPtr); }
   const_reference operator*() const noexcept { return *static_cast<const_pointer>(mPtr); }
 
-  reference       operator->() noexcept { return *static_cast<pointer>(mPtr); }
-  const_reference operator->() const noexcept { return *static_cast<const_pointer>(mPtr); }
+  pointer       operator->() noexcept { return static_cast<pointer>(mPtr); }
+  const_pointer operator->() const noexcept { return static_cast<const_pointer>(mPtr); }
 
   constexpr bool operator==(const avl_tree_iterator rhs) const noexcept {
     return (mTree == rhs.mTree && mPtr == rhs.mPtr);
@@ -162,14 +525,20 @@ public:
 
   pointer get() const noexcept { return static_cast<pointer>(mPtr); }
 
-  friend class avl_tree<T, Compare>;
+  friend class avl_tree<T, Compare, Node>;
+  friend class avl_tree_const_iterator<T, Compare, Node>;
 
 private:
-  avl_tree<T, Compare> *mTree = nullptr;
-  avl_node             *mPtr  = nullptr;
+  /// Index of this iterator. end() is at size().
+  difference_type index() const noexcept {
+    return static_cast<difference_type>((mPtr == nullptr) ? mTree->size() : mTree->index_of(get()));
+  }
+
+  avl_tree<T, Compare, Node> *mTree = nullptr;
+  Node                       *mPtr  = nullptr;
 };
 
-template <class T, class Compare>
+template <class T, class Compare, class Node>
 class avl_tree_const_iterator {
 public:
   using value_type        = const T;
@@ -178,14 +547,22 @@ public:
   using pointer           = const T *;
   using const_pointer     = const T *;
   using difference_type   = std::ptrdiff_t;
-  using iterator_category = std::bidirectional_iterator_tag;
 
-  constexpr avl_tree_const_iterator(const avl_tree<T, Compare> *tree = nullptr,
-                                    const avl_node             *node = nullptr) noexcept
+  /// Iterators of order statistic trees are random access, see avl_rank_node.
+  using iterator_category =
+      typename std::conditional<avl_tree_detail::is_ranked_node<Node>::value,
+                                std::random_access_iterator_tag,
+                                std::bidirectional_iterator_tag>::type;
+
+  constexpr avl_tree_const_iterator(const avl_tree<T, Compare, Node> *tree = nullptr,
+                                    const Node                       *node = nullptr) noexcept
       : mTree(tree), mPtr(node) {}
 
   constexpr avl_tree_const_iterator(const avl_tree_const_iterator &) noexcept = default;
 
+  constexpr avl_tree_const_iterator(const avl_tree_iterator<T, Compare, Node> &other) noexcept
+      : mTree(other.mTree), mPtr(other.mPtr) {}
+
   avl_tree_const_iterator &operator++() noexcept {
     if (mPtr != nullptr) {
       mPtr = mPtr->next();
@@ -203,13 +580,7 @@ public:
     if (mPtr != nullptr) {
       mPtr = mPtr->prev();
     } else {
-      mPtr = static_cast<avl_node *>(mTree->root());
-
-      if (mPtr == nullptr)
-        return (*this);
-
-      while (mPtr->right() != nullptr)
-        mPtr = mPtr->right();
+      mPtr = mTree->mRightmost;
     }
     return (*this);
   }
@@ -220,11 +591,52 @@ public:
     return ret;
   }
 
+  // Random access operators below take O(log n) time and are available only if Node is
+  // avl_rank_node.
+
+  avl_tree_const_iterator &operator+=(difference_type n) noexcept {
+    difference_type target = index() + n;
+    assert(target >= 0 && static_cast<size_t>(target) <= mTree->size());
+    mPtr = mTree->select(static_cast<size_t>(target));
+    return (*this);
+  }
+
+  avl_tree_const_iterator &operator-=(difference_type n) noexcept { return (*this) += -n; }
+
+  avl_tree_const_iterator operator+(difference_type n) const noexcept {
+    avl_tree_const_iterator ret = (*this);
+    return ret += n;
+  }
+
+  avl_tree_const_iterator operator-(difference_type n) const noexcept {
+    avl_tree_const_iterator ret = (*this);
+    return ret -= n;
+  }
+
+  friend avl_tree_const_iterator operator+(difference_type               n,
+                                           const avl_tree_const_iterator it) noexcept {
+    return it + n;
+  }
+
+  difference_type operator-(const avl_tree_const_iterator rhs) const noexcept {
+    return index() - rhs.index();
+  }
+
+  reference       operator[](difference_type n) noexcept { return *((*this) + n); }
+  const_reference operator[](difference_type n) const noexcept { return *((*this) + n); }
+
+  bool operator<(const avl_tree_const_iterator rhs) const noexcept {
+    return index() < rhs.index();
+  }
+  bool operator>(const avl_tree_const_iterator rhs) const noexcept { return rhs < (*this); }
+  bool operator<=(const avl_tree_const_iterator rhs) const noexcept { return !(rhs < (*this)); }
+  bool operator>=(const avl_tree_const_iterator rhs) const noexcept { return !((*this) < rhs); }
+
   reference       operator*() noexcept { return *static_cast<pointer>(mPtr); }
   const_reference operator*() const noexcept { return *static_cast<const_pointer>(mPtr); }
 
-  reference       operator->() noexcept { return *static_cast<pointer>(mPtr); }
-  const_reference operator->() const noexcept { return *static_cast<const_pointer>(mPtr); }
+  pointer       operator->() noexcept { return static_cast<pointer>(mPtr); }
+  const_pointer operator->() const noexcept { return static_cast<const_pointer>(mPtr); }
 
   constexpr bool operator==(const avl_tree_const_iterator rhs) const noexcept {
     return (mTree == rhs.mTree && mPtr == rhs.mPtr);
@@ -236,14 +648,24 @@ public:
 
   const_pointer get() const noexcept { return static_cast<const_pointer>(mPtr); }
 
-  friend class avl_tree<T, Compare>;
+  friend class avl_tree<T, Compare, Node>;
 
 private:
-  const avl_tree<T, Compare> *mTree = nullptr;
-  const avl_node             *mPtr  = nullptr;
+  /// Index of this iterator. end() is at size().
+  difference_type index() const noexcept {
+    return static_cast<difference_type>((mPtr == nullptr) ? mTree->size() : mTree->index_of(get()));
+  }
+
+  const avl_tree<T, Compare, Node> *mTree = nullptr;
+  const Node                       *mPtr  = nullptr;
 };
 
-template <class T, class Compare = std::less<T>>
+/// Node is the node policy of the tree and T should inherit from it. It could be one of:
+/// - avl_node: Default node, which stores height of the subtree.
+/// - avl_compact_node: Stores balance factor in the parent pointer to save 8 bytes per node.
+/// - avl_rank_node: Also stores size of the subtree to support order statistics.
+/// - avl_augmented_node<T>: Maintains user-defined aggregates by calling T::recompute().
+template <class T, class Compare = std::less<T>, class Node = avl_node>
 class avl_tree {
 public:
   using key_type        = T;
@@ -256,10 +678,11 @@ public:
   using value_compare   = Compare;
   using pointer         = value_type *;
   using const_pointer   = const value_type *;
-  using iterator        = avl_tree_iterator<T, Compare>;
-  using const_iterator  = avl_tree_const_iterator<T, Compare>;
+  using node_type       = Node;
+  using iterator        = avl_tree_iterator<T, Compare, Node>;
+  using const_iterator  = avl_tree_const_iterator<T, Compare, Node>;
 
-  static_assert(std::is_base_of<avl_node, T>::value, "T should inhert from avl_node_meta.");
+  static_assert(std::is_base_of<Node, T>::value, "T should inhert from Node.");
 
   avl_tree() noexcept(std::is_nothrow_default_constructible<Compare>::value)
       : mValue(nullptr, Compare()) {}
@@ -270,27 +693,58 @@ public:
   avl_tree(const avl_tree &other) = default;
   avl_tree &operator=(const avl_tree &other) = default;
 
-  bool      empty() const noexcept { return mSize; }
-  size_type size() const noexcept { return mSize; }
+  bool empty() const noexcept { return mValue.first() == nullptr; }
+
+  /// Number of nodes in this tree. It takes O(n) time if size_known() is false.
+  size_type size() const noexcept { return size_known() ? mSize : count_nodes(mValue.first()); }
 
-  pointer root() noexcept { return static_cast<pointer>(mValue.first()); }
+  /// Trees created by split(), join() or set operations may not know their sizes unless Node keeps
+  /// subtree sizes (avl_rank_node). Inserting or erasing nodes keeps the size unknown.
+  bool size_known() const noexcept { return mSize != unknown_size; }
 
-  const_pointer root() const noexcept { return static_cast<const_pointer>(mValue.first()); }
+  /// Count nodes in O(n) time if the size is unknown, so that size() takes O(1) time afterwards.
+  size_type recount() noexcept {
+    if (!size_known())
+      mSize = count_nodes(mValue.first());
+    return mSize;
+  }
+
+  pointer root() noexcept { return static_cast<pointer>(static_cast<Node *>(mValue.first())); }
+
+  const_pointer root() const noexcept {
+    return static_cast<const_pointer>(static_cast<const Node *>(mValue.first()));
+  }
 
-  iterator begin() noexcept;
-  iterator end() noexcept;
+  iterator       begin() noexcept { return iterator(this, mLeftmost); }
+  const_iterator begin() const noexcept { return const_iterator(this, mLeftmost); }
 
-  const_iterator begin() const noexcept;
-  const_iterator end() const noexcept;
+  iterator       end() noexcept { return iterator(this, nullptr); }
+  const_iterator end() const noexcept { return const_iterator(this, nullptr); }
 
-  const_iterator cbegin() const noexcept;
-  const_iterator cend() const noexcept;
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+
+  /// The first and last nodes are cached, so front() and back() are O(1). The tree should not be
+  /// empty.
+  reference front() noexcept {
+    assert(!empty());
+    return *static_cast<pointer>(mLeftmost);
+  }
+
+  const_reference front() const noexcept {
+    assert(!empty());
+    return *static_cast<const_pointer>(mLeftmost);
+  }
 
-  reference front() noexcept;
-  reference back() noexcept;
+  reference back() noexcept {
+    assert(!empty());
+    return *static_cast<pointer>(mRightmost);
+  }
 
-  const_reference front() const noexcept;
-  const_reference back() const noexcept;
+  const_reference back() const noexcept {
+    assert(!empty());
+    return *static_cast<const_pointer>(mRightmost);
+  }
 
   /// Return false if there is already a node equal to current one.
   bool insert_unique(pointer node) noexcept;
@@ -301,9 +755,45 @@ public:
 
   void insert_multi(pointer node) noexcept;
 
+  /// Insert node right before hint if node fits between hint and its predecessor, which takes only
+  /// two comparisons. Otherwise, fall back to insert_unique(node). Inserting a sorted batch with
+  /// the previous insertion position as hint is amortized O(1).
+  bool insert_unique(const_iterator hint, pointer node) noexcept;
+
+  /// Same as insert_unique(hint, node) but allows node to be equal to its neighbors.
+  void insert_multi(const_iterator hint, pointer node) noexcept;
+
+  /// Fast path for inserting increasing values, such as timestamps or sequence numbers. If node is
+  /// greater than back(), it is linked to the last node directly with only one comparison.
+  /// Otherwise, fall back to insert_unique().
+  bool insert_back(pointer node) noexcept;
+
+  /// Same as insert_back() but allows node to be equal to back(). Fall back to insert_multi() if
+  /// node is less than back().
+  void insert_back_multi(pointer node) noexcept;
+
   /// Make sure that node belongs to current tree.
   void erase(pointer node) noexcept;
 
+  /// Remove the first node from tree and return it. Return nullptr if tree is empty. Together with
+  /// insert_multi(), this makes avl_tree usable as an ordered priority queue.
+  pointer pop_front() noexcept {
+    if (empty())
+      return nullptr;
+    pointer node = static_cast<pointer>(mLeftmost);
+    erase(node);
+    return node;
+  }
+
+  /// Remove the last node from tree and return it. Return nullptr if tree is empty.
+  pointer pop_back() noexcept {
+    if (empty())
+      return nullptr;
+    pointer node = static_cast<pointer>(mRightmost);
+    erase(node);
+    return node;
+  }
+
   void erase(iterator node) noexcept {
     assert(node.mTree == this);
     assert(node.mPtr != nullptr);
@@ -313,6 +803,92 @@ public:
   template <class Func>
   void clear(Func &&handler);
 
+  /// Replace content of this tree with a sorted range of nodes in O(n) time. The result is a
+  /// perfectly balanced tree and no comparison or rotation is performed. Iterator could either
+  /// point to value_type or pointer, and should be at least a forward iterator.
+  ///
+  /// The range must be sorted and must not contain equal nodes, which is checked only in debug
+  /// mode. Nodes in this tree before are detached without being visited. Call clear() first if
+  /// they should be released.
+  template <class Iterator>
+  void assign_sorted(Iterator first, Iterator last) noexcept;
+
+  /// Same as assign_sorted() but the range may contain equal nodes.
+  template <class Iterator>
+  void assign_sorted_multi(Iterator first, Iterator last) noexcept;
+
+  /// Insert a batch of nodes. RandomIt should be a random access iterator to pointer, and the
+  /// range is sorted in place. Depending on ratio of batch size to tree size, nodes are either
+  /// inserted one by one, or merged with all nodes in this tree and rebuilt into a balanced tree in
+  /// O(n + m) time.
+  ///
+  /// Nodes that are equal to an existing node or to another node in the batch are passed to
+  /// handler. Return number of inserted nodes.
+  template <class RandomIt, class Func>
+  size_type insert_bulk(RandomIt first, RandomIt last, Func &&handler);
+
+  /// Split this tree in O(log n) time. Nodes less than value go to the first tree and the others go
+  /// to the second one. This tree is empty after splitting. Sizes of the two trees may be unknown,
+  /// see size_known().
+  std::pair<avl_tree, avl_tree> split(const_reference value) noexcept { return split_impl(value); }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  std::pair<avl_tree, avl_tree> split(const Key &key) noexcept {
+    return split_impl(key);
+  }
+
+  /// Concatenate left, pivot and right in O(log n) time and return the new tree. Nodes in left
+  /// should not be greater than pivot, and nodes in right should not be less than pivot. left and
+  /// right are empty after joining.
+  static avl_tree join(avl_tree &left, pointer pivot, avl_tree &right) noexcept;
+
+  /// Same as join() but the first node of right is used as pivot.
+  static avl_tree join2(avl_tree &left, avl_tree &right) noexcept;
+
+  // Set operations below are based on split() and join(). They relink nodes instead of copying
+  // them and take O(m log(n / m + 1)) time, where m is size of the smaller tree. Both trees should
+  // not contain equal nodes. Dropped nodes are passed to handler. Parallel versions are in
+  // avl_tree_parallel.h.
+
+  /// Move all nodes of other into this tree. Nodes of other equal to existing ones are dropped.
+  /// other is empty afterwards.
+  template <class Func>
+  void set_union(avl_tree &other, Func &&handler) {
+    set_union_impl<size_type>(other, handler, avl_tree_detail::sequential_fork());
+  }
+
+  /// Remove nodes that are not in other, which takes additional O(k) time for k removed nodes.
+  /// other is not modified.
+  template <class Func>
+  void set_intersection(const avl_tree &other, Func &&handler) {
+    set_intersection_impl<size_type>(other, handler, avl_tree_detail::sequential_fork());
+  }
+
+  /// Remove nodes that are also in other. other is not modified.
+  template <class Func>
+  void set_difference(const avl_tree &other, Func &&handler) {
+    set_difference_impl<size_type>(other, handler, avl_tree_detail::sequential_fork());
+  }
+
+  /// Move all nodes of other into this tree, and drop nodes that are in both trees. other is empty
+  /// afterwards.
+  template <class Func>
+  void set_symmetric_difference(avl_tree &other, Func &&handler) {
+    set_symmetric_difference_impl<size_type>(other, handler, avl_tree_detail::sequential_fork());
+  }
+
+  template <class RandomIt>
+  size_type insert_bulk(RandomIt first, RandomIt last) noexcept {
+    return insert_bulk(first, last, [](pointer) noexcept {});
+  }
+
+  /// Same as insert_bulk() but allows equal nodes.
+  template <class RandomIt>
+  void insert_bulk_multi(RandomIt first, RandomIt last) noexcept {
+    auto handler = [](pointer) noexcept {};
+    insert_bulk_impl(first, last, false, handler);
+  }
+
   pointer       find(const_reference value) noexcept;
   const_pointer find(const_reference value) const noexcept;
 
@@ -323,6 +899,7 @@ public:
   ///   - negative integer: value is smaller than current node.
   ///   - positive integer: value is greater than current node.
   ///   - 0: value is equal to current node.
+  /// Prefer the heterogeneous find() below if Compare can be made transparent.
   template <class Value, class Fn>
   pointer find(Fn &&cmp, Value &&value) noexcept;
 
@@ -336,132 +913,514 @@ public:
   template <class Value, class Fn>
   const_pointer find(Fn &&cmp, Value &&value) const noexcept;
 
-  key_compare   key_comp() const noexcept { return mValue.second(); }
-  value_compare value_comp() const noexcept { return mValue.second(); }
+  /// Heterogeneous lookup. Only enabled if Compare::is_transparent is defined, in which case
+  /// Compare should accept (const Key &, const_reference) and (const_reference, const Key &), so
+  /// that no temporary value_type has to be built for searching.
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  pointer find(const Key &key) noexcept {
+    return static_cast<pointer>(const_cast<node_pointer>(find_node(key)));
+  }
 
-  friend class avl_node;
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_pointer find(const Key &key) const noexcept {
+    return static_cast<const_pointer>(find_node(key));
+  }
 
-private:
-  template <class Func>
-  void clear_impl(avl_node *node, Func &handler);
+  /// Find n values at once. out[i] is set to the node equal to values[i], or nullptr if there is
+  /// none. Up to find_batch_width lookups go down the tree in lockstep, one level per round, and
+  /// the next node of each lookup is prefetched a round before it is visited, so that cache misses
+  /// of different lookups overlap. This pays off for trees much larger than cache, with 8 or more
+  /// values per call.
+  void find_batch(const_pointer values, size_type n, pointer *out) noexcept {
+    find_batch_impl(values, n, out);
+  }
 
-private:
-  size_type                            mSize = 0;
-  compressed_pair<avl_node *, Compare> mValue;
-};
+  void find_batch(const_pointer values, size_type n, const_pointer *out) const noexcept {
+    find_batch_impl(values, n, out);
+  }
 
-inline bool avl_node::is_left() const noexcept {
-  if (parent() == nullptr)
-    return false;
-  return (parent()->left() == this);
-}
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  void find_batch(const Key *keys, size_type n, pointer *out) noexcept {
+    find_batch_impl(keys, n, out);
+  }
 
-inline bool avl_node::is_right() const noexcept {
-  if (parent() == nullptr)
-    return false;
-  return (parent()->right() == this);
-}
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  void find_batch(const Key *keys, size_type n, const_pointer *out) const noexcept {
+    find_batch_impl(keys, n, out);
+  }
 
-inline auto avl_node::next() const noexcept -> const_pointer {
-  if (right() != nullptr) {
-    pointer node = right();
+  /// Max number of lookups in flight in find_batch().
+  static constexpr size_type find_batch_width = 32;
 
-    while (node->left() != nullptr)
-      node = node->left();
+  size_type count(const_reference value) const noexcept { return count_impl(value); }
 
-    return node;
-  } else {
-    const_pointer node = this;
-    for (;;) {
-      const_pointer last = node;
-      node               = node->parent();
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  size_type count(const Key &key) const noexcept {
+    return count_impl(key);
+  }
 
-      if (node == nullptr)
-        break;
+  bool contains(const_reference value) const noexcept { return find_node(value) != nullptr; }
 
-      if (node->left() == last)
-        break;
-    }
-    return node;
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  bool contains(const Key &key) const noexcept {
+    return find_node(key) != nullptr;
   }
-}
 
-inline auto avl_node::next() noexcept -> pointer {
-  if (right() != nullptr) {
-    pointer node = right();
+  /// Return iterator to the first node that is not less than value.
+  iterator lower_bound(const_reference value) noexcept {
+    return iterator(this, const_cast<node_pointer>(lower_bound_node(value)));
+  }
 
-    while (node->left() != nullptr)
-      node = node->left();
+  const_iterator lower_bound(const_reference value) const noexcept {
+    return const_iterator(this, lower_bound_node(value));
+  }
 
-    return node;
-  } else {
-    pointer node = this;
-    for (;;) {
-      pointer last = node;
-      node         = node->parent();
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  iterator lower_bound(const Key &key) noexcept {
+    return iterator(this, const_cast<node_pointer>(lower_bound_node(key)));
+  }
 
-      if (node == nullptr)
-        break;
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_iterator lower_bound(const Key &key) const noexcept {
+    return const_iterator(this, lower_bound_node(key));
+  }
 
-      if (node->left() == last)
-        break;
-    }
-    return node;
+  /// Return iterator to the first node that is greater than value.
+  iterator upper_bound(const_reference value) noexcept {
+    return iterator(this, const_cast<node_pointer>(upper_bound_node(value)));
   }
-}
 
-inline auto avl_node::prev() const noexcept -> const_pointer {
-  if (left() != nullptr) {
-    pointer node = left();
+  const_iterator upper_bound(const_reference value) const noexcept {
+    return const_iterator(this, upper_bound_node(value));
+  }
 
-    while (node->right() != nullptr)
-      node = node->right();
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  iterator upper_bound(const Key &key) noexcept {
+    return iterator(this, const_cast<node_pointer>(upper_bound_node(key)));
+  }
 
-    return node;
-  } else {
-    const_pointer node = this;
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_iterator upper_bound(const Key &key) const noexcept {
+    return const_iterator(this, upper_bound_node(key));
+  }
 
-    for (;;) {
-      const_pointer last = node;
-      node               = node->parent();
+  std::pair<iterator, iterator> equal_range(const_reference value) noexcept {
+    return {lower_bound(value), upper_bound(value)};
+  }
 
-      if (node == nullptr)
-        break;
+  std::pair<const_iterator, const_iterator> equal_range(const_reference value) const noexcept {
+    return {lower_bound(value), upper_bound(value)};
+  }
 
-      if (node->right() == last)
-        break;
-    }
-    return node;
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  std::pair<iterator, iterator> equal_range(const Key &key) noexcept {
+    return {lower_bound(key), upper_bound(key)};
   }
-}
 
-inline auto avl_node::prev() noexcept -> pointer {
-  if (left() != nullptr) {
-    pointer node = left();
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  std::pair<const_iterator, const_iterator> equal_range(const Key &key) const noexcept {
+    return {lower_bound(key), upper_bound(key)};
+  }
 
-    while (node->right() != nullptr)
-      node = node->right();
+  /// Return iterator to the last node that is not greater than value, or end() if there is none.
+  iterator floor(const_reference value) noexcept {
+    return iterator(this, const_cast<node_pointer>(floor_node(value)));
+  }
 
-    return node;
-  } else {
-    pointer node = this;
+  const_iterator floor(const_reference value) const noexcept {
+    return const_iterator(this, floor_node(value));
+  }
 
-    for (;;) {
-      pointer last = node;
-      node         = node->parent();
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  iterator floor(const Key &key) noexcept {
+    return iterator(this, const_cast<node_pointer>(floor_node(key)));
+  }
 
-      if (node == nullptr)
-        break;
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_iterator floor(const Key &key) const noexcept {
+    return const_iterator(this, floor_node(key));
+  }
 
-      if (node->right() == last)
-        break;
+  /// Return iterator to the first node that is not less than value, or end() if there is none.
+  /// Same as lower_bound().
+  iterator ceiling(const_reference value) noexcept { return lower_bound(value); }
+
+  const_iterator ceiling(const_reference value) const noexcept { return lower_bound(value); }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  iterator ceiling(const Key &key) noexcept {
+    return lower_bound(key);
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_iterator ceiling(const Key &key) const noexcept {
+    return lower_bound(key);
+  }
+
+  /// Same as avl_tree_nearest in avlmini. Return iterator to a node equal to value if there is
+  /// one. Otherwise, return the last node visited when searching for value, which is either the
+  /// floor or the ceiling of value. Return end() only if the tree is empty.
+  iterator nearest(const_reference value) noexcept {
+    return iterator(this, const_cast<node_pointer>(nearest_node(value)));
+  }
+
+  const_iterator nearest(const_reference value) const noexcept {
+    return const_iterator(this, nearest_node(value));
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  iterator nearest(const Key &key) noexcept {
+    return iterator(this, const_cast<node_pointer>(nearest_node(key)));
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_iterator nearest(const Key &key) const noexcept {
+    return const_iterator(this, nearest_node(key));
+  }
+
+  // Order statistics below require Node to be avl_rank_node, and take O(log n) time.
+
+  /// Return the k-th smallest node, counting from 0. Return nullptr if k is not less than size().
+  pointer select(size_type k) noexcept {
+    return static_cast<pointer>(const_cast<node_pointer>(select_node(k)));
+  }
+
+  const_pointer select(size_type k) const noexcept {
+    return static_cast<const_pointer>(select_node(k));
+  }
+
+  /// Number of nodes less than value, which is also index of lower_bound(value).
+  size_type rank(const_reference value) const noexcept { return rank_impl(value); }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  size_type rank(const Key &key) const noexcept {
+    return rank_impl(key);
+  }
+
+  /// Number of nodes in [lo, hi).
+  size_type count_range(const_reference lo, const_reference hi) const noexcept {
+    return count_range_impl(lo, hi);
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  size_type count_range(const Key &lo, const Key &hi) const noexcept {
+    return count_range_impl(lo, hi);
+  }
+
+  /// Index of node in this tree, found by walking up to the root. Make sure that node belongs to
+  /// current tree.
+  size_type index_of(const_pointer node) const noexcept;
+
+  /// Split this tree in O(log n) time. The first k nodes go to the first tree and the others go to
+  /// the second one. This tree is empty after splitting.
+  std::pair<avl_tree, avl_tree> split_first(size_type k) noexcept;
+
+  // Queries below are mainly for augmented nodes, see avl_augmented_node.
+
+  /// Walk down from root. fn is called with each visited node and returns a negative value to go
+  /// left, a positive value to go right, or 0 to stop at current node. Return the node stopped at,
+  /// or nullptr if fn never returns 0.
+  template <class Func>
+  pointer descend(Func &&fn) noexcept(noexcept(fn(std::declval<const_reference>()))) {
+    return static_cast<pointer>(const_cast<node_pointer>(descend_node(fn)));
+  }
+
+  template <class Func>
+  const_pointer descend(Func &&fn) const noexcept(noexcept(fn(std::declval<const_reference>()))) {
+    return static_cast<const_pointer>(descend_node(fn));
+  }
+
+  /// Decompose nodes in [lo, hi) into O(log n) single nodes and whole subtrees, so that aggregates
+  /// of the range could be computed from aggregates of subtrees. node_fn is called with each single
+  /// node and subtree_fn is called with root of each subtree, in no particular order.
+  template <class NodeFunc, class SubtreeFunc>
+  void fold_range(const_reference lo,
+                  const_reference hi,
+                  NodeFunc      &&node_fn,
+                  SubtreeFunc   &&subtree_fn) const {
+    fold_range_impl(lo, hi, node_fn, subtree_fn);
+  }
+
+  template <class Key,
+            class NodeFunc,
+            class SubtreeFunc,
+            class C = Compare,
+            class   = typename C::is_transparent>
+  void fold_range(const Key     &lo,
+                  const Key     &hi,
+                  NodeFunc     &&node_fn,
+                  SubtreeFunc  &&subtree_fn) const {
+    fold_range_impl(lo, hi, node_fn, subtree_fn);
+  }
+
+  /// Update aggregates of node and its ancestors after fields of node used by recompute() are
+  /// changed in place. Keys must not be changed.
+  void recompute(pointer node) noexcept { static_cast<node_pointer>(node)->update_path(); }
+
+  key_compare   key_comp() const noexcept { return mValue.second(); }
+  value_compare value_comp() const noexcept { return mValue.second(); }
+
+  /// Compare can either be a less-than predicate returning bool, or a three-way comparator
+  /// returning an integer (or an ordering type) whose sign tells the order of the two arguments.
+  /// Three-way comparators are called exactly once per tree level.
+  static constexpr bool is_three_way =
+      avl_tree_detail::is_three_way_compare<Compare, value_type, value_type>::value;
+
+  /// Whether Node stores subtree size, which enables order statistics.
+  static constexpr bool is_ranked = avl_tree_detail::is_ranked_node<Node>::value;
+
+  template <class, class>
+  friend class basic_avl_node;
+  friend class avl_compact_node;
+  friend iterator;
+  friend const_iterator;
+  friend struct avl_tree_detail::parallel_set_operations<avl_tree>;
+
+private:
+  using node_pointer       = Node *;
+  using const_node_pointer = const Node *;
+
+  /// Link node to parent as a new leaf and rebalance the tree. Parent should be nullptr if the
+  /// tree is empty.
+  void insert_leaf(node_pointer node, node_pointer parent, bool left) noexcept;
+
+  /// Link node between 2 adjacent nodes. prev or next is nullptr if node is the first or last one.
+  void insert_between(node_pointer node, node_pointer prev, node_pointer next) noexcept {
+    if (next != nullptr && next->left() == nullptr)
+      insert_leaf(node, next, true);
+    else
+      insert_leaf(node, prev, false);
+  }
+
+  /// Return a negative integer if lhs < rhs, a positive integer if rhs < lhs, 0 otherwise.
+  template <class L, class R>
+  int compare(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::compare(
+        mValue.second(), lhs, rhs, std::integral_constant<bool, is_three_way>());
+  }
+
+  /// Return true if lhs < rhs. Only one comparison is needed for both kinds of comparators.
+  template <class L, class R>
+  bool less(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::less(
+        mValue.second(), lhs, rhs, std::integral_constant<bool, is_three_way>());
+  }
+
+  template <class Key>
+  const_node_pointer find_node(const Key &key) const noexcept;
+  template <class Key>
+  const_node_pointer lower_bound_node(const Key &key) const noexcept;
+  template <class Key>
+  const_node_pointer upper_bound_node(const Key &key) const noexcept;
+  template <class Key>
+  const_node_pointer floor_node(const Key &key) const noexcept;
+  template <class Key>
+  const_node_pointer nearest_node(const Key &key) const noexcept;
+  template <class Key>
+  size_type count_impl(const Key &key) const noexcept;
+  template <class Key, class Pointer>
+  void find_batch_impl(const Key *keys, size_type n, Pointer *out) const noexcept;
+
+  template <class Func>
+  void clear_impl(node_pointer node, Func &handler);
+
+  static size_type count_nodes(const_node_pointer node) noexcept {
+    return count_nodes(node, std::integral_constant<bool, is_ranked>());
+  }
+
+  static size_type count_nodes(const_node_pointer node, std::true_type) noexcept {
+    return size_of(node);
+  }
+
+  static size_type count_nodes(const_node_pointer node, std::false_type) noexcept {
+    size_type count = 0;
+    for (; node != nullptr; node = node->right())
+      count += count_nodes(node->left(), std::false_type()) + 1;
+    return count;
+  }
+
+  static size_type size_of(const_node_pointer node) noexcept {
+    return (node == nullptr) ? 0 : node->size();
+  }
+
+  const_node_pointer select_node(size_type k) const noexcept;
+
+  template <class Func>
+  const_node_pointer descend_node(Func &fn) const;
+  template <class Key, class NodeFunc, class SubtreeFunc>
+  void fold_range_impl(const Key   &lo,
+                       const Key   &hi,
+                       NodeFunc    &node_fn,
+                       SubtreeFunc &subtree_fn) const;
+
+  template <class Key>
+  size_type rank_impl(const Key &key) const noexcept;
+  template <class Key>
+  size_type count_range_impl(const Key &lo, const Key &hi) const noexcept;
+
+  /// Height of subtree. Walking down along the higher child takes O(log n) time for both node
+  /// policies.
+  static size_type height_of(const_node_pointer node) noexcept {
+    size_type height = 0;
+    for (; node != nullptr; height += 1)
+      node = (node->balance() < 0) ? node->left() : node->right();
+    return height;
+  }
+
+  void reset() noexcept {
+    mValue.first() = nullptr;
+    mLeftmost      = nullptr;
+    mRightmost     = nullptr;
+    mSize          = 0;
+  }
+
+  /// Make root the root of this tree. Leftmost and rightmost nodes are found in O(log n) time.
+  void assign_root(node_pointer root, size_type size) noexcept;
+
+  /// Ranked nodes keep subtree sizes, so the size of a ranked tree is always known.
+  static size_type known_size(const_node_pointer root, size_type size, std::true_type) noexcept {
+    return (size == unknown_size) ? size_of(root) : size;
+  }
+
+  static size_type known_size(const_node_pointer, size_type size, std::false_type) noexcept {
+    return size;
+  }
+
+  /// Root and height of a detached subtree. Parent pointer of root may be stale.
+  struct subtree {
+    node_pointer root;
+    size_type    height;
+  };
+
+  subtree whole() noexcept { return {mValue.first(), height_of(mValue.first())}; }
+
+  static subtree left_of(subtree tree) noexcept {
+    return {tree.root->left(), tree.height - ((tree.root->balance() > 0) ? 2 : 1)};
+  }
+
+  static subtree right_of(subtree tree) noexcept {
+    return {tree.root->right(), tree.height - ((tree.root->balance() < 0) ? 2 : 1)};
+  }
+
+  /// Join subtrees left and right with pivot in O(|hl - hr|) time. Root of this tree is used as
+  /// scratch and is overwritten.
+  subtree join_nodes(subtree left, node_pointer pivot, subtree right) noexcept;
+
+  /// Same as join_nodes() but the last node of left is used as pivot.
+  subtree join2_nodes(subtree left, subtree right) noexcept;
+
+  /// Remove the last node of tree and return it by last.
+  subtree split_last(subtree tree, node_pointer &last) noexcept;
+
+  /// Split tree into nodes less than key and the others.
+  template <class Key>
+  void split_nodes(subtree tree, const Key &key, subtree &left, subtree &right) noexcept;
+
+  /// Split tree into nodes less than key and nodes greater than key. Return the node equal to key
+  /// if there is one. Otherwise, return nullptr.
+  template <class Key>
+  node_pointer split_at(subtree tree, const Key &key, subtree &left, subtree &right) noexcept;
+
+  /// Split tree into the first k nodes and the others.
+  void split_nodes_first(subtree tree, size_type k, subtree &left, subtree &right) noexcept;
+
+  template <class Key>
+  std::pair<avl_tree, avl_tree> split_impl(const Key &key) noexcept;
+
+  // The recursions of set operations call fork(tree, height, left, right) to run their two
+  // independent halves, where height is the height of the smaller subtree. left and right should be
+  // called with a tree used as scratch by join_nodes() and the Fork to be used by them. Counter
+  // counts dropped nodes, and should be atomic if halves run concurrently.
+
+  template <class Counter, class Func, class Fork>
+  void set_union_impl(avl_tree &other, Func &handler, Fork fork);
+  template <class Counter, class Func, class Fork>
+  void set_intersection_impl(const avl_tree &other, Func &handler, Fork fork);
+  template <class Counter, class Func, class Fork>
+  void set_difference_impl(const avl_tree &other, Func &handler, Fork fork);
+  template <class Counter, class Func, class Fork>
+  void set_symmetric_difference_impl(avl_tree &other, Func &handler, Fork fork);
+
+  template <class Func, class Fork>
+  subtree union_nodes(subtree lhs, subtree rhs, Func &handler, Fork fork);
+  template <class Func, class Fork>
+  subtree intersection_nodes(subtree lhs, const_node_pointer rhs, Func &handler, Fork fork);
+  template <class Func, class Fork>
+  subtree difference_nodes(subtree lhs, const_node_pointer rhs, Func &handler, Fork fork);
+  template <class Func, class Fork>
+  subtree symmetric_difference_nodes(subtree lhs, subtree rhs, Func &handler, Fork fork);
+
+  static pointer to_pointer(pointer node) noexcept { return node; }
+  static pointer to_pointer(reference node) noexcept { return std::addressof(node); }
+
+  template <class Iterator>
+  bool is_sorted_range(Iterator first, Iterator last, bool unique) const noexcept;
+
+  /// Build a balanced subtree with the next n nodes from first. Height of the subtree is returned
+  /// by height.
+  template <class Iterator>
+  static node_pointer build(Iterator &first, size_type n, size_type &height) noexcept;
+
+  /// Replace content of this tree with n nodes from first.
+  template <class Iterator>
+  void assign_range(Iterator first, size_type n) noexcept;
+
+  /// Iterates a list of nodes linked by right child.
+  struct list_iterator {
+    node_pointer node;
+
+    pointer operator*() const noexcept { return static_cast<pointer>(node); }
+
+    list_iterator &operator++() noexcept {
+      node = node->right();
+      return *this;
     }
-    return node;
+  };
+
+  /// Link nodes of the subtree in order by right child, and append head to the end.
+  static node_pointer flatten(node_pointer node, node_pointer head) noexcept;
+
+  /// Inserting one node costs O(log n) while rebuilding touches every node once. Rebuilding costs
+  /// a few cache misses per node, so it pays off only when the batch is large enough.
+  bool prefer_rebuild(size_type batch) noexcept {
+    size_type size  = recount();
+    size_type depth = 1;
+    for (size_type n = size; n > 1; n >>= 1)
+      depth += 1;
+    return batch * depth >= size * 4;
   }
+
+  template <class RandomIt, class Func>
+  size_type insert_bulk_impl(RandomIt first, RandomIt last, bool unique, Func &handler);
+
+private:
+  static constexpr size_type unknown_size = static_cast<size_type>(-1);
+
+  size_type                                          mSize      = 0;
+  Node                                              *mLeftmost  = nullptr;
+  Node                                              *mRightmost = nullptr;
+  compressed_pair<typename Node::link_type, Compare> mValue;
+};
+
+template <class Augment, class Link>
+bool basic_avl_node<Augment, Link>::is_left() const noexcept {
+  if (parent() == nullptr)
+    return false;
+  return (parent()->left() == this);
 }
 
-template <class T, class Compare>
-void avl_node::replace_as_child(pointer node, pointer parent, avl_tree<T, Compare> &tree) noexcept {
+template <class Augment, class Link>
+bool basic_avl_node<Augment, Link>::is_right() const noexcept {
+  if (parent() == nullptr)
+    return false;
+  return (parent()->right() == this);
+}
+
+template <class Augment, class Link>
+template <class Tree>
+void basic_avl_node<Augment, Link>::replace_as_child(pointer node,
+                                                     pointer parent,
+                                                     Tree   &tree) noexcept {
   if (parent != nullptr) {
     if (parent->left() == this)
       parent->mLeft = node;
@@ -472,8 +1431,9 @@ void avl_node::replace_as_child(pointer node, pointer parent, avl_tree<T, Compar
   }
 }
 
-template <class T, class Compare>
-void avl_node::replace(pointer node, avl_tree<T, Compare> &tree) noexcept {
+template <class Augment, class Link>
+template <class Tree>
+void basic_avl_node<Augment, Link>::replace(pointer node, Tree &tree) noexcept {
   replace_as_child(node, parent(), tree);
 
   if (left() != nullptr)
@@ -486,10 +1446,12 @@ void avl_node::replace(pointer node, avl_tree<T, Compare> &tree) noexcept {
   node->mRight  = right();
   node->mParent = parent();
   node->mHeight = height();
+  node->update_augment();
 }
 
-template <class T, class Compare>
-auto avl_node::rotate_left(avl_tree<T, Compare> &tree) noexcept -> pointer {
+template <class Augment, class Link>
+template <class Tree>
+auto basic_avl_node<Augment, Link>::rotate_left(Tree &tree) noexcept -> pointer {
   assert(right() != nullptr);
 
   pointer r   = right();
@@ -509,8 +1471,9 @@ auto avl_node::rotate_left(avl_tree<T, Compare> &tree) noexcept -> pointer {
   return r;
 }
 
-template <class T, class Compare>
-auto avl_node::rotate_right(avl_tree<T, Compare> &tree) noexcept -> pointer {
+template <class Augment, class Link>
+template <class Tree>
+auto basic_avl_node<Augment, Link>::rotate_right(Tree &tree) noexcept -> pointer {
   assert(left() != nullptr);
 
   pointer l   = left();
@@ -529,8 +1492,9 @@ auto avl_node::rotate_right(avl_tree<T, Compare> &tree) noexcept -> pointer {
   return l;
 }
 
-template <class T, class Compare>
-auto avl_node::fix_left(avl_tree<T, Compare> &tree) noexcept -> pointer {
+template <class Augment, class Link>
+template <class Tree>
+auto basic_avl_node<Augment, Link>::fix_left(Tree &tree) noexcept -> pointer {
   pointer r = right();
   assert(r);
   size_type rh0 = (r->left() ? r->left()->height() : 0);
@@ -547,8 +1511,9 @@ auto avl_node::fix_left(avl_tree<T, Compare> &tree) noexcept -> pointer {
   return node;
 }
 
-template <class T, class Compare>
-auto avl_node::fix_right(avl_tree<T, Compare> &tree) noexcept -> pointer {
+template <class Augment, class Link>
+template <class Tree>
+auto basic_avl_node<Augment, Link>::fix_right(Tree &tree) noexcept -> pointer {
   pointer l = left();
   assert(l);
   size_type rh0 = (l->left() ? l->left()->height() : 0);
@@ -565,156 +1530,319 @@ auto avl_node::fix_right(avl_tree<T, Compare> &tree) noexcept -> pointer {
   return node;
 }
 
-template <class T, class Compare>
-void avl_node::rebalance(avl_tree<T, Compare> &tree) noexcept {
+template <class Augment, class Link>
+template <class Tree>
+void basic_avl_node<Augment, Link>::rebalance(Tree &tree) noexcept {
   for (pointer node = this; node != nullptr; node = node->parent()) {
     pointer   l      = node->left();
     pointer   r      = node->right();
     size_type hl     = (l == nullptr) ? 0 : l->height();
     size_type hr     = (r == nullptr) ? 0 : r->height();
     size_type height = std::max(hl, hr) + 1;
+    auto      diff   = static_cast<int32_t>(hl) - static_cast<int32_t>(hr);
 
-    if (node->height() == height)
+    if (diff <= -2) {
+      node = node->fix_left(tree);
+    } else if (diff >= 2) {
+      node = node->fix_right(tree);
+    } else if (node->height() != height) {
+      node->mHeight = height;
+    } else {
       break;
+    }
+  }
+}
 
-    node->mHeight = height;
-    auto diff     = static_cast<int32_t>(hl) - static_cast<int32_t>(hr);
+template <class Augment, class Link>
+template <class Tree>
+bool basic_avl_node<Augment, Link>::fix_growth(Tree &tree) noexcept {
+  bool    grew = true;
+  pointer node = this;
+  for (pointer p = node->parent(); p != nullptr; p = node->parent()) {
+    pointer   l      = p->left();
+    pointer   r      = p->right();
+    size_type hl     = (l == nullptr) ? 0 : l->height();
+    size_type hr     = (r == nullptr) ? 0 : r->height();
+    size_type height = p->height();
+    auto      diff   = static_cast<int32_t>(hl) - static_cast<int32_t>(hr);
 
     if (diff <= -2) {
-      node = node->fix_left(tree);
+      node = p->fix_left(tree);
     } else if (diff >= 2) {
-      node = node->fix_right(tree);
+      node = p->fix_right(tree);
+    } else {
+      p->mHeight = std::max(hl, hr) + 1;
+      node       = p;
+    }
+
+    if (node->height() == height) {
+      grew = false;
+      break;
     }
   }
+
+  // Rotated nodes are updated by update_height(), and nodes that are not rotated are all ancestors
+  // of this node.
+  update_path();
+  return grew;
 }
 
-template <class T, class Compare>
-void avl_node::fix_insert(avl_tree<T, Compare> &tree) noexcept {
+template <class Augment, class Link>
+template <class Tree>
+void basic_avl_node<Augment, Link>::fix_insert(Tree &tree) noexcept {
   mLeft = mRight = nullptr;
   mHeight        = 1;
-  if (parent())
-    parent()->rebalance(tree);
+  fix_growth(tree);
 }
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::begin() noexcept -> iterator {
-  avl_node *node = mValue.first();
+template <class Augment, class Link>
+template <class Tree>
+void basic_avl_node<Augment, Link>::fix_erase(bool, Tree &tree) noexcept {
+  rebalance(tree);
+  update_path();
+}
 
-  if (node == nullptr)
-    return nullptr;
+template <class Tree>
+void avl_compact_node::replace_as_child(pointer node, pointer parent, Tree &tree) noexcept {
+  if (parent != nullptr) {
+    if (parent->left() == this)
+      parent->mLeft = node;
+    else
+      parent->mRight = node;
+  } else {
+    tree.mValue.first() = node;
+  }
+}
 
-  while (node->left() != nullptr)
-    node = node->left();
+template <class Tree>
+void avl_compact_node::replace(pointer node, Tree &tree) noexcept {
+  replace_as_child(node, parent(), tree);
+
+  if (left() != nullptr)
+    left()->set_parent(node);
 
-  return iterator(this, node);
+  if (right() != nullptr)
+    right()->set_parent(node);
+
+  node->mLeft   = left();
+  node->mRight  = right();
+  node->mParent = mParent;
 }
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::begin() const noexcept -> const_iterator {
-  avl_node *node = mValue.first();
+template <class Tree>
+auto avl_compact_node::rotate_left(Tree &tree) noexcept -> pointer {
+  assert(right() != nullptr);
 
-  if (node == nullptr)
-    return nullptr;
+  pointer r   = right();
+  pointer par = parent();
 
-  while (node->left() != nullptr)
-    node = node->left();
+  mRight = r->left();
+  if (right() != nullptr)
+    right()->set_parent(this);
 
-  return const_iterator(this, node);
-}
+  r->mLeft = this;
+  r->set_parent(par);
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::end() noexcept -> iterator {
-  return iterator(this, nullptr);
-}
+  replace_as_child(r, par, tree);
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::end() const noexcept -> const_iterator {
-  return const_iterator(this, nullptr);
+  set_parent(r);
+  return r;
 }
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::front() noexcept -> reference {
-  avl_node *node = mValue.first();
+template <class Tree>
+auto avl_compact_node::rotate_right(Tree &tree) noexcept -> pointer {
+  assert(left() != nullptr);
 
-  if (node == nullptr)
-    return nullptr;
+  pointer l   = left();
+  pointer par = parent();
 
-  while (node->left() != nullptr)
-    node = node->left();
+  mLeft = l->right();
+  if (left() != nullptr)
+    left()->set_parent(this);
 
-  return *static_cast<pointer>(node);
-}
+  l->mRight = this;
+  l->set_parent(par);
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::front() const noexcept -> const_reference {
-  avl_node *node = mValue.first();
+  replace_as_child(l, par, tree);
 
-  if (node == nullptr)
-    return nullptr;
+  set_parent(l);
+  return l;
+}
 
-  while (node->left() != nullptr)
-    node = node->left();
+/// Right subtree is 2 levels higher than the left one.
+template <class Tree>
+auto avl_compact_node::fix_left(Tree &tree) noexcept -> pointer {
+  pointer r = right();
+  assert(r);
+
+  if (r->balance() >= 0) {
+    int rb = r->balance();
+    rotate_left(tree);
+    // rb is 0 only when erasing, and height of the subtree does not change in this case.
+    set_balance(rb == 0 ? 1 : 0);
+    r->set_balance(rb == 0 ? -1 : 0);
+    return r;
+  }
 
-  return *static_cast<pointer>(node);
+  pointer g  = r->left();
+  int     gb = g->balance();
+  r->rotate_right(tree);
+  rotate_left(tree);
+  set_balance(gb > 0 ? -1 : 0);
+  r->set_balance(gb < 0 ? 1 : 0);
+  g->set_balance(0);
+  return g;
 }
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::back() noexcept -> reference {
-  avl_node *node = mValue.first();
+/// Left subtree is 2 levels higher than the right one.
+template <class Tree>
+auto avl_compact_node::fix_right(Tree &tree) noexcept -> pointer {
+  pointer l = left();
+  assert(l);
 
-  if (node == nullptr)
-    return nullptr;
+  if (l->balance() <= 0) {
+    int lb = l->balance();
+    rotate_right(tree);
+    // lb is 0 only when erasing, and height of the subtree does not change in this case.
+    set_balance(lb == 0 ? -1 : 0);
+    l->set_balance(lb == 0 ? 1 : 0);
+    return l;
+  }
 
-  while (node->right() != nullptr)
-    node = node->right();
+  pointer g  = l->right();
+  int     gb = g->balance();
+  l->rotate_left(tree);
+  rotate_right(tree);
+  l->set_balance(gb > 0 ? -1 : 0);
+  set_balance(gb < 0 ? 1 : 0);
+  g->set_balance(0);
+  return g;
+}
 
-  return *static_cast<pointer>(node);
+template <class Tree>
+bool avl_compact_node::fix_growth(Tree &tree) noexcept {
+  // Height of child increased by 1.
+  pointer child = this;
+  for (pointer node = parent(); node != nullptr; child = node, node = node->parent()) {
+    if (node->left() == child) {
+      if (node->balance() > 0) {
+        node->set_balance(0);
+        return false;
+      } else if (node->balance() == 0) {
+        node->set_balance(-1);
+      } else {
+        node->fix_right(tree);
+        return false;
+      }
+    } else {
+      if (node->balance() < 0) {
+        node->set_balance(0);
+        return false;
+      } else if (node->balance() == 0) {
+        node->set_balance(1);
+      } else {
+        node->fix_left(tree);
+        return false;
+      }
+    }
+  }
+  return true;
 }
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::back() const noexcept -> const_reference {
-  avl_node *node = mValue.first();
+template <class Tree>
+void avl_compact_node::fix_insert(Tree &tree) noexcept {
+  mLeft = mRight = nullptr;
+  set_balance(0);
+  fix_growth(tree);
+}
 
-  if (node == nullptr)
-    return nullptr;
+template <class Tree>
+void avl_compact_node::fix_erase(bool left, Tree &tree) noexcept {
+  // Height of left or right subtree of node decreased by 1.
+  pointer node = this;
+  for (;;) {
+    if (left) {
+      if (node->balance() < 0) {
+        node->set_balance(0);
+      } else if (node->balance() == 0) {
+        node->set_balance(1);
+        return;
+      } else {
+        bool stop = (node->right()->balance() == 0);
+        node      = node->fix_left(tree);
+        if (stop)
+          return;
+      }
+    } else {
+      if (node->balance() > 0) {
+        node->set_balance(0);
+      } else if (node->balance() == 0) {
+        node->set_balance(-1);
+        return;
+      } else {
+        bool stop = (node->left()->balance() == 0);
+        node      = node->fix_right(tree);
+        if (stop)
+          return;
+      }
+    }
 
-  while (node->right() != nullptr)
-    node = node->right();
+    pointer parent = node->parent();
+    if (parent == nullptr)
+      return;
 
-  return *static_cast<pointer>(node);
+    left = (parent->left() == node);
+    node = parent;
+  }
 }
 
-template <class T, class Compare>
-bool avl_tree<T, Compare>::insert_unique(pointer obj) noexcept {
-  auto node    = static_cast<avl_node *>(obj);
-  auto current = static_cast<avl_node *>(root());
-  if (current == nullptr) {
+template <class T, class Compare, class Node>
+void avl_tree<T, Compare, Node>::insert_leaf(node_pointer node,
+                                             node_pointer parent,
+                                             bool         left) noexcept {
+  if (parent == nullptr) {
     mValue.first() = node;
-    node->mParent = node->mLeft = node->mRight = nullptr;
-    node->mHeight                              = 1;
+    mLeftmost      = node;
+    mRightmost     = node;
+  } else if (left) {
+    parent->set_left(node);
+    if (parent == mLeftmost)
+      mLeftmost = node;
+  } else {
+    parent->set_right(node);
+    if (parent == mRightmost)
+      mRightmost = node;
+  }
+
+  node->set_parent(parent);
+  node->fix_insert(*this);
+  if (mSize != unknown_size)
     mSize += 1;
+}
+
+template <class T, class Compare, class Node>
+bool avl_tree<T, Compare, Node>::insert_unique(pointer obj) noexcept {
+  auto node    = static_cast<node_pointer>(obj);
+  auto current = static_cast<node_pointer>(root());
+  if (current == nullptr) {
+    insert_leaf(node, nullptr, true);
     return true;
   }
 
   for (;;) {
-    if (value_comp()(*static_cast<pointer>(node), *static_cast<pointer>(current))) {
+    int cmp = compare(*obj, *static_cast<pointer>(current));
+    if (cmp < 0) {
       if (current->left() != nullptr) {
         current = current->left();
       } else {
-        current->mLeft = node;
-        node->mParent  = current;
-        node->fix_insert(*this);
-        mSize += 1;
+        insert_leaf(node, current, true);
         return true;
       }
-    } else if (value_comp()(*static_cast<pointer>(current), *static_cast<pointer>(node))) {
+    } else if (cmp > 0) {
       if (current->right() != nullptr) {
         current = current->right();
       } else {
-        current->mRight = node;
-        node->mParent   = current;
-        node->fix_insert(*this);
-        mSize += 1;
+        insert_leaf(node, current, false);
         return true;
       }
     } else {
@@ -724,94 +1852,78 @@ bool avl_tree<T, Compare>::insert_unique(pointer obj) noexcept {
   }
 }
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::insert_or_replace(pointer obj) noexcept -> pointer {
-  auto node    = static_cast<avl_node *>(obj);
-  auto current = static_cast<avl_node *>(root());
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::insert_or_replace(pointer obj) noexcept -> pointer {
+  auto node    = static_cast<node_pointer>(obj);
+  auto current = static_cast<node_pointer>(root());
   if (current == nullptr) {
-    mValue.first() = node;
-    node->mParent = node->mLeft = node->mRight = nullptr;
-    node->mHeight                              = 1;
+    insert_leaf(node, nullptr, true);
     return nullptr;
   }
 
   for (;;) {
-    if (value_comp()(*static_cast<pointer>(current), *static_cast<pointer>(node))) {
+    int cmp = compare(*obj, *static_cast<pointer>(current));
+    if (cmp < 0) {
       if (current->left() != nullptr) {
         current = current->left();
       } else {
-        current->mLeft = node;
-        node->mParent  = current;
-        node->fix_insert(*this);
-        mSize += 1;
+        insert_leaf(node, current, true);
         return nullptr;
       }
-    } else if (value_comp()(*static_cast<pointer>(node), *static_cast<pointer>(current))) {
+    } else if (cmp > 0) {
       if (current->right() != nullptr) {
         current = current->right();
       } else {
-        current->mRight = node;
-        node->mParent   = current;
-        node->fix_insert(*this);
-        mSize += 1;
+        insert_leaf(node, current, false);
         return nullptr;
       }
     } else {
       // Replace
       current->replace(node, *this);
+      if (current == mLeftmost)
+        mLeftmost = node;
+      if (current == mRightmost)
+        mRightmost = node;
       return static_cast<pointer>(current);
     }
   }
 }
 
-template <class T, class Compare>
-void avl_tree<T, Compare>::insert_multi(pointer obj) noexcept {
-  auto node    = static_cast<avl_node *>(obj);
-  auto current = static_cast<avl_node *>(root());
+template <class T, class Compare, class Node>
+void avl_tree<T, Compare, Node>::insert_multi(pointer obj) noexcept {
+  auto node    = static_cast<node_pointer>(obj);
+  auto current = static_cast<node_pointer>(root());
   if (current == nullptr) {
-    mValue.first() = node;
-    node->mParent = node->mLeft = node->mRight = nullptr;
-    node->mHeight                              = 1;
-    mSize += 1;
+    insert_leaf(node, nullptr, true);
     return;
   }
 
   for (;;) {
-    if (value_comp()(*static_cast<pointer>(node), *static_cast<pointer>(current))) {
+    int cmp = compare(*obj, *static_cast<pointer>(current));
+    if (cmp < 0) {
       if (current->left() != nullptr) {
         current = current->left();
       } else {
-        current->mLeft = node;
-        node->mParent  = current;
-        node->fix_insert(*this);
-        mSize += 1;
+        insert_leaf(node, current, true);
         return;
       }
-    } else if (value_comp()(*static_cast<pointer>(current), *static_cast<pointer>(node))) {
+    } else if (cmp > 0) {
       if (current->right() != nullptr) {
         current = current->right();
       } else {
-        current->mRight = node;
-        node->mParent   = current;
-        node->fix_insert(*this);
-        mSize += 1;
+        insert_leaf(node, current, false);
         return;
       }
     } else {
       if (current->left() == nullptr) {
-        current->mLeft = node;
-        node->mParent  = current;
-        node->fix_insert(*this);
-        mSize += 1;
+        insert_leaf(node, current, true);
         return;
       } else if (current->right() == nullptr) {
-        current->mRight = node;
-        node->mParent   = current;
-        node->fix_insert(*this);
-        mSize += 1;
+        insert_leaf(node, current, false);
         return;
       } else {
-        if (current->left()->height() < current->right()->height())
+        // Go to the lower subtree.
+        if (current->balance() > 0)
           current = current->left();
         else
           current = current->right();
@@ -820,42 +1932,86 @@ void avl_tree<T, Compare>::insert_multi(pointer obj) noexcept {
   }
 }
 
-template <class T, class Compare>
-void avl_tree<T, Compare>::erase(pointer obj) noexcept {
-  auto      node = static_cast<avl_node *>(obj);
-  avl_node *child, *parent;
+template <class T, class Compare, class Node>
+bool avl_tree<T, Compare, Node>::insert_unique(const_iterator hint, pointer obj) noexcept {
+  assert(hint.mTree == this);
+  auto next = const_cast<node_pointer>(hint.mPtr);
+  auto prev = (next == nullptr) ? mRightmost : next->prev();
+
+  if ((next == nullptr || less(*obj, *static_cast<pointer>(next))) &&
+      (prev == nullptr || less(*static_cast<pointer>(prev), *obj))) {
+    insert_between(obj, prev, next);
+    return true;
+  }
+  return insert_unique(obj);
+}
+
+template <class T, class Compare, class Node>
+void avl_tree<T, Compare, Node>::insert_multi(const_iterator hint, pointer obj) noexcept {
+  assert(hint.mTree == this);
+  auto next = const_cast<node_pointer>(hint.mPtr);
+  auto prev = (next == nullptr) ? mRightmost : next->prev();
+
+  if ((next == nullptr || !less(*static_cast<pointer>(next), *obj)) &&
+      (prev == nullptr || !less(*obj, *static_cast<pointer>(prev)))) {
+    insert_between(obj, prev, next);
+    return;
+  }
+  insert_multi(obj);
+}
+
+template <class T, class Compare, class Node>
+bool avl_tree<T, Compare, Node>::insert_back(pointer obj) noexcept {
+  if (mRightmost != nullptr && less(*static_cast<pointer>(mRightmost), *obj)) {
+    insert_leaf(obj, mRightmost, false);
+    return true;
+  }
+  return insert_unique(obj);
+}
+
+template <class T, class Compare, class Node>
+void avl_tree<T, Compare, Node>::insert_back_multi(pointer obj) noexcept {
+  if (mRightmost != nullptr && !less(*obj, *static_cast<pointer>(mRightmost))) {
+    insert_leaf(obj, mRightmost, false);
+    return;
+  }
+  insert_multi(obj);
+}
+
+template <class T, class Compare, class Node>
+void avl_tree<T, Compare, Node>::erase(pointer obj) noexcept {
+  auto         node = static_cast<node_pointer>(obj);
+  node_pointer child, parent;
+  bool         left;
+
+  // Leftmost node has no left child and rightmost node has no right child, so the new leftmost
+  // and rightmost nodes are at most 2 levels away.
+  if (node == mLeftmost)
+    mLeftmost = node->next();
+  if (node == mRightmost)
+    mRightmost = node->prev();
 
   if (node->left() != nullptr && node->right() != nullptr) {
-    avl_node *old = node;
-    avl_node *left;
+    node_pointer old = node;
+    node_pointer next;
     node = node->right();
 
-    while ((left = node->left()) != nullptr)
-      node = left;
+    while ((next = node->left()) != nullptr)
+      node = next;
 
     child  = node->right();
     parent = node->parent();
+    left   = (parent != old);
 
     if (child)
-      child->mParent = parent;
+      child->set_parent(parent);
 
     node->replace_as_child(child, parent, *this);
 
-    if (node->parent() == old)
+    if (parent == old)
       parent = node;
 
-    node->mLeft   = old->left();
-    node->mRight  = old->right();
-    node->mParent = old->parent();
-    node->mHeight = old->height();
-
-    old->replace_as_child(node, old->parent(), *this);
-    assert(old->left() != nullptr);
-    old->left()->mParent = node;
-
-    if (old->right()) {
-      old->right()->mParent = node;
-    }
+    old->replace(node, *this);
   } else {
     if (node->left() == nullptr)
       child = node->right();
@@ -863,33 +2019,34 @@ void avl_tree<T, Compare>::erase(pointer obj) noexcept {
       child = node->left();
 
     parent = node->parent();
+    left   = (parent != nullptr && parent->left() == node);
     node->replace_as_child(child, parent, *this);
 
     if (child)
-      child->mParent = parent;
+      child->set_parent(parent);
   }
 
   if (parent != nullptr)
-    parent->rebalance(*this);
+    parent->fix_erase(left, *this);
 
-  mSize -= 1;
+  if (mSize != unknown_size)
+    mSize -= 1;
 }
 
-template <class T, class Compare>
+template <class T, class Compare, class Node>
 template <class Func>
-void avl_tree<T, Compare>::clear(Func &&handler) {
+void avl_tree<T, Compare, Node>::clear(Func &&handler) {
   if (mValue.first() != nullptr) {
     clear_impl(mValue.first(), handler);
-    mValue.first() = nullptr;
-    mSize          = 0;
+    reset();
   }
 }
 
-template <class T, class Compare>
+template <class T, class Compare, class Node>
 template <class Func>
-void avl_tree<T, Compare>::clear_impl(avl_node *node, Func &handler) {
-  avl_node *left  = node->left();
-  avl_node *right = node->right();
+void avl_tree<T, Compare, Node>::clear_impl(node_pointer node, Func &handler) {
+  node_pointer left  = node->left();
+  node_pointer right = node->right();
 
   handler(static_cast<pointer>(node));
   if (left != nullptr)
@@ -898,40 +2055,746 @@ void avl_tree<T, Compare>::clear_impl(avl_node *node, Func &handler) {
     clear_impl(right, handler);
 }
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::find(const_reference value) noexcept -> pointer {
-  auto node = static_cast<avl_node *>(root());
+template <class T, class Compare, class Node>
+template <class Iterator>
+void avl_tree<T, Compare, Node>::assign_sorted(Iterator first, Iterator last) noexcept {
+  assert(is_sorted_range(first, last, true));
+  assign_range(first, static_cast<size_type>(std::distance(first, last)));
+}
+
+template <class T, class Compare, class Node>
+template <class Iterator>
+void avl_tree<T, Compare, Node>::assign_sorted_multi(Iterator first, Iterator last) noexcept {
+  assert(is_sorted_range(first, last, false));
+  assign_range(first, static_cast<size_type>(std::distance(first, last)));
+}
+
+template <class T, class Compare, class Node>
+template <class Iterator>
+bool avl_tree<T, Compare, Node>::is_sorted_range(Iterator first,
+                                                 Iterator last,
+                                                 bool     unique) const noexcept {
+  if (first == last)
+    return true;
+
+  pointer prev = to_pointer(*first);
+  for (++first; first != last; ++first) {
+    pointer node = to_pointer(*first);
+    if (unique ? !less(*prev, *node) : less(*node, *prev))
+      return false;
+    prev = node;
+  }
+  return true;
+}
+
+template <class T, class Compare, class Node>
+template <class Iterator>
+auto avl_tree<T, Compare, Node>::build(Iterator &first, size_type n, size_type &height) noexcept
+    -> node_pointer {
+  if (n == 0) {
+    height = 0;
+    return nullptr;
+  }
+
+  size_type    left_height, right_height;
+  node_pointer left = build(first, (n - 1) / 2, left_height);
+
+  node_pointer node = to_pointer(*first);
+  ++first;
+
+  node_pointer right = build(first, n - 1 - (n - 1) / 2, right_height);
+
+  node->set_left(left);
+  node->set_right(right);
+  node->reset_balance(left_height, right_height);
+
+  if (left != nullptr)
+    left->set_parent(node);
+  if (right != nullptr)
+    right->set_parent(node);
+
+  height = std::max(left_height, right_height) + 1;
+  return node;
+}
+
+template <class T, class Compare, class Node>
+template <class Iterator>
+void avl_tree<T, Compare, Node>::assign_range(Iterator first, size_type n) noexcept {
+  size_type height;
+  assign_root(build(first, n, height), n);
+}
+
+template <class T, class Compare, class Node>
+void avl_tree<T, Compare, Node>::assign_root(node_pointer root, size_type size) noexcept {
+  mValue.first() = root;
+  mSize          = known_size(root, size, std::integral_constant<bool, is_ranked>());
+  mLeftmost      = root;
+  mRightmost     = root;
+
+  if (root != nullptr) {
+    root->set_parent(nullptr);
+    while (mLeftmost->left() != nullptr)
+      mLeftmost = mLeftmost->left();
+    while (mRightmost->right() != nullptr)
+      mRightmost = mRightmost->right();
+  }
+}
+
+template <class T, class Compare, class Node>
+template <class RandomIt, class Func>
+auto avl_tree<T, Compare, Node>::insert_bulk(RandomIt first, RandomIt last, Func &&handler)
+    -> size_type {
+  return insert_bulk_impl(first, last, true, handler);
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::flatten(node_pointer node, node_pointer head) noexcept
+    -> node_pointer {
   while (node != nullptr) {
-    if (value_comp()(value, *static_cast<pointer>(node))) {
+    head              = flatten(node->right(), head);
+    node_pointer left = node->left();
+    node->set_right(head);
+    head = node;
+    node = left;
+  }
+  return head;
+}
+
+template <class T, class Compare, class Node>
+template <class RandomIt, class Func>
+auto avl_tree<T, Compare, Node>::insert_bulk_impl(RandomIt first,
+                                                  RandomIt last,
+                                                  bool     unique,
+                                                  Func    &handler) -> size_type {
+  if (first == last)
+    return 0;
+
+  std::sort(first, last, [this](pointer l, pointer r) { return less(*l, *r); });
+
+  size_type count = 0;
+  if (!prefer_rebuild(static_cast<size_type>(std::distance(first, last)))) {
+    for (; first != last; ++first) {
+      if (!unique) {
+        insert_multi(*first);
+        count += 1;
+      } else if (insert_unique(*first)) {
+        count += 1;
+      } else {
+        handler(*first);
+      }
+    }
+    return count;
+  }
+
+  // Merge the batch into the flattened tree. Existing nodes go first when equal, so that equal
+  // nodes from the batch are always compared against the tail.
+  node_pointer tree = flatten(mValue.first(), nullptr);
+  node_pointer head = nullptr;
+  node_pointer tail = nullptr;
+  size_type    size = 0;
+
+  while (tree != nullptr || first != last) {
+    node_pointer node;
+    if (first != last && (tree == nullptr || less(**first, *static_cast<pointer>(tree)))) {
+      pointer obj = *first;
+      ++first;
+      if (unique && tail != nullptr && !less(*static_cast<pointer>(tail), *obj)) {
+        handler(obj);
+        continue;
+      }
+      node  = obj;
+      count += 1;
+    } else {
+      node = tree;
+      tree = tree->right();
+    }
+
+    if (tail == nullptr)
+      head = node;
+    else
+      tail->set_right(node);
+    tail  = node;
+    size += 1;
+  }
+
+  assign_range(list_iterator{head}, size);
+  return count;
+}
+
+template <class T, class Compare, class Node>
+constexpr typename avl_tree<T, Compare, Node>::size_type avl_tree<T, Compare, Node>::unknown_size;
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::join_nodes(subtree      left,
+                                            node_pointer pivot,
+                                            subtree      right) noexcept -> subtree {
+  if (left.root != nullptr)
+    left.root->set_parent(nullptr);
+  if (right.root != nullptr)
+    right.root->set_parent(nullptr);
+
+  if (left.height > right.height + 1) {
+    // Walk down the right spine of left until a subtree of height hr or hr + 1 is found.
+    node_pointer parent = nullptr;
+    subtree      node   = left;
+    while (node.height > right.height + 1) {
+      parent = node.root;
+      node   = right_of(node);
+    }
+
+    pivot->set_left(node.root);
+    pivot->set_right(right.root);
+    pivot->reset_balance(node.height, right.height);
+    if (node.root != nullptr)
+      node.root->set_parent(pivot);
+    if (right.root != nullptr)
+      right.root->set_parent(pivot);
+
+    parent->set_right(pivot);
+    pivot->set_parent(parent);
+
+    // Subtree at pivot is always 1 level higher than the replaced one.
+    mValue.first() = left.root;
+    if (pivot->fix_growth(*this))
+      left.height += 1;
+    return {mValue.first(), left.height};
+  }
+
+  if (right.height > left.height + 1) {
+    node_pointer parent = nullptr;
+    subtree      node   = right;
+    while (node.height > left.height + 1) {
+      parent = node.root;
+      node   = left_of(node);
+    }
+
+    pivot->set_left(left.root);
+    pivot->set_right(node.root);
+    pivot->reset_balance(left.height, node.height);
+    if (left.root != nullptr)
+      left.root->set_parent(pivot);
+    if (node.root != nullptr)
+      node.root->set_parent(pivot);
+
+    parent->set_left(pivot);
+    pivot->set_parent(parent);
+
+    mValue.first() = right.root;
+    if (pivot->fix_growth(*this))
+      right.height += 1;
+    return {mValue.first(), right.height};
+  }
+
+  pivot->set_left(left.root);
+  pivot->set_right(right.root);
+  pivot->reset_balance(left.height, right.height);
+  pivot->set_parent(nullptr);
+  if (left.root != nullptr)
+    left.root->set_parent(pivot);
+  if (right.root != nullptr)
+    right.root->set_parent(pivot);
+
+  mValue.first() = pivot;
+  return {pivot, std::max(left.height, right.height) + 1};
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::join2_nodes(subtree left, subtree right) noexcept -> subtree {
+  if (left.root == nullptr)
+    return right;
+  if (right.root == nullptr)
+    return left;
+
+  node_pointer last;
+  left = split_last(left, last);
+  return join_nodes(left, last, right);
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::split_last(subtree tree, node_pointer &last) noexcept -> subtree {
+  subtree left = left_of(tree);
+  if (tree.root->right() == nullptr) {
+    last = tree.root;
+    return left;
+  }
+
+  subtree right = split_last(right_of(tree), last);
+  return join_nodes(left, tree.root, right);
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+void avl_tree<T, Compare, Node>::split_nodes(subtree    tree,
+                                             const Key &key,
+                                             subtree   &left,
+                                             subtree   &right) noexcept {
+  if (tree.root == nullptr) {
+    left = right = tree;
+    return;
+  }
+
+  subtree l = left_of(tree);
+  subtree r = right_of(tree);
+  subtree middle;
+  if (less(*static_cast<pointer>(tree.root), key)) {
+    split_nodes(r, key, middle, right);
+    left = join_nodes(l, tree.root, middle);
+  } else {
+    split_nodes(l, key, left, middle);
+    right = join_nodes(middle, tree.root, r);
+  }
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::split_at(subtree    tree,
+                                          const Key &key,
+                                          subtree   &left,
+                                          subtree   &right) noexcept -> node_pointer {
+  if (tree.root == nullptr) {
+    left = right = tree;
+    return nullptr;
+  }
+
+  subtree l   = left_of(tree);
+  subtree r   = right_of(tree);
+  int     cmp = compare(*static_cast<pointer>(tree.root), key);
+  if (cmp == 0) {
+    left  = l;
+    right = r;
+    return tree.root;
+  }
+
+  subtree      middle;
+  node_pointer found;
+  if (cmp < 0) {
+    found = split_at(r, key, middle, right);
+    left  = join_nodes(l, tree.root, middle);
+  } else {
+    found = split_at(l, key, left, middle);
+    right = join_nodes(middle, tree.root, r);
+  }
+  return found;
+}
+
+template <class T, class Compare, class Node>
+void avl_tree<T, Compare, Node>::split_nodes_first(subtree    tree,
+                                                   size_type  k,
+                                                   subtree   &left,
+                                                   subtree   &right) noexcept {
+  if (tree.root == nullptr) {
+    left = right = tree;
+    return;
+  }
+
+  subtree   l         = left_of(tree);
+  subtree   r         = right_of(tree);
+  size_type left_size = size_of(l.root);
+  subtree   middle;
+  if (left_size < k) {
+    split_nodes_first(r, k - left_size - 1, middle, right);
+    left = join_nodes(l, tree.root, middle);
+  } else {
+    split_nodes_first(l, k, left, middle);
+    right = join_nodes(middle, tree.root, r);
+  }
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::split_first(size_type k) noexcept
+    -> std::pair<avl_tree, avl_tree> {
+  static_assert(is_ranked, "split_first() requires avl_rank_node.");
+  std::pair<avl_tree, avl_tree> result{avl_tree(key_comp()), avl_tree(key_comp())};
+  if (empty())
+    return result;
+
+  subtree left, right;
+  split_nodes_first(whole(), k, left, right);
+
+  result.first.assign_root(left.root, size_of(left.root));
+  result.second.assign_root(right.root, size_of(right.root));
+  reset();
+  return result;
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::split_impl(const Key &key) noexcept
+    -> std::pair<avl_tree, avl_tree> {
+  std::pair<avl_tree, avl_tree> result{avl_tree(key_comp()), avl_tree(key_comp())};
+  if (empty())
+    return result;
+
+  subtree left, right;
+  split_nodes(whole(), key, left, right);
+
+  result.first.assign_root(left.root, (right.root == nullptr) ? mSize : unknown_size);
+  result.second.assign_root(right.root, (left.root == nullptr) ? mSize : unknown_size);
+  reset();
+  return result;
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::join(avl_tree &left, pointer pivot, avl_tree &right) noexcept
+    -> avl_tree {
+  assert(left.empty() || !left.less(*pivot, left.back()));
+  assert(right.empty() || !left.less(right.front(), *pivot));
+
+  avl_tree tree(left.key_comp());
+  tree.join_nodes(left.whole(), pivot, right.whole());
+
+  tree.mLeftmost  = left.empty() ? pivot : left.mLeftmost;
+  tree.mRightmost = right.empty() ? pivot : right.mRightmost;
+  tree.mSize      = (left.mSize == unknown_size || right.mSize == unknown_size)
+                        ? unknown_size
+                        : left.mSize + right.mSize + 1;
+
+  left.reset();
+  right.reset();
+  return tree;
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::join2(avl_tree &left, avl_tree &right) noexcept -> avl_tree {
+  if (right.empty()) {
+    avl_tree tree(left);
+    left.reset();
+    return tree;
+  }
+  pointer pivot = right.pop_front();
+  return join(left, pivot, right);
+}
+
+template <class T, class Compare, class Node>
+constexpr typename avl_tree<T, Compare, Node>::size_type
+    avl_tree<T, Compare, Node>::find_batch_width;
+
+template <class T, class Compare, class Node>
+template <class Func, class Fork>
+auto avl_tree<T, Compare, Node>::union_nodes(subtree lhs, subtree rhs, Func &handler, Fork fork)
+    -> subtree {
+  if (lhs.root == nullptr)
+    return rhs;
+  if (rhs.root == nullptr)
+    return lhs;
+
+  node_pointer pivot = lhs.root;
+  subtree      l1    = left_of(lhs);
+  subtree      r1    = right_of(lhs);
+  subtree      l2, r2;
+  node_pointer found = split_at(rhs, *static_cast<pointer>(pivot), l2, r2);
+  if (found != nullptr)
+    handler(static_cast<pointer>(found));
+
+  subtree left, right;
+  fork(
+      *this, std::min(lhs.height, rhs.height),
+      [&](avl_tree &tree, Fork f) { left = tree.union_nodes(l1, l2, handler, f); },
+      [&](avl_tree &tree, Fork f) { right = tree.union_nodes(r1, r2, handler, f); });
+  return join_nodes(left, pivot, right);
+}
+
+template <class T, class Compare, class Node>
+template <class Func, class Fork>
+auto avl_tree<T, Compare, Node>::intersection_nodes(subtree            lhs,
+                                                    const_node_pointer rhs,
+                                                    Func              &handler,
+                                                    Fork               fork) -> subtree {
+  if (lhs.root == nullptr)
+    return lhs;
+  if (rhs == nullptr) {
+    clear_impl(lhs.root, handler);
+    return {nullptr, 0};
+  }
+
+  subtree      l1, r1;
+  node_pointer found = split_at(lhs, *static_cast<const_pointer>(rhs), l1, r1);
+
+  subtree left, right;
+  fork(
+      *this, lhs.height,
+      [&](avl_tree &tree, Fork f) {
+        left = tree.intersection_nodes(l1, rhs->left(), handler, f);
+      },
+      [&](avl_tree &tree, Fork f) {
+        right = tree.intersection_nodes(r1, rhs->right(), handler, f);
+      });
+
+  if (found != nullptr)
+    return join_nodes(left, found, right);
+  return join2_nodes(left, right);
+}
+
+template <class T, class Compare, class Node>
+template <class Func, class Fork>
+auto avl_tree<T, Compare, Node>::difference_nodes(subtree            lhs,
+                                                  const_node_pointer rhs,
+                                                  Func              &handler,
+                                                  Fork               fork) -> subtree {
+  if (lhs.root == nullptr || rhs == nullptr)
+    return lhs;
+
+  subtree      l1, r1;
+  node_pointer found = split_at(lhs, *static_cast<const_pointer>(rhs), l1, r1);
+  if (found != nullptr)
+    handler(static_cast<pointer>(found));
+
+  subtree left, right;
+  fork(
+      *this, lhs.height,
+      [&](avl_tree &tree, Fork f) {
+        left = tree.difference_nodes(l1, rhs->left(), handler, f);
+      },
+      [&](avl_tree &tree, Fork f) {
+        right = tree.difference_nodes(r1, rhs->right(), handler, f);
+      });
+  return join2_nodes(left, right);
+}
+
+template <class T, class Compare, class Node>
+template <class Func, class Fork>
+auto avl_tree<T, Compare, Node>::symmetric_difference_nodes(subtree lhs,
+                                                            subtree rhs,
+                                                            Func   &handler,
+                                                            Fork    fork) -> subtree {
+  if (lhs.root == nullptr)
+    return rhs;
+  if (rhs.root == nullptr)
+    return lhs;
+
+  node_pointer pivot = lhs.root;
+  subtree      l1    = left_of(lhs);
+  subtree      r1    = right_of(lhs);
+  subtree      l2, r2;
+  node_pointer found = split_at(rhs, *static_cast<pointer>(pivot), l2, r2);
+
+  subtree left, right;
+  fork(
+      *this, std::min(lhs.height, rhs.height),
+      [&](avl_tree &tree, Fork f) {
+        left = tree.symmetric_difference_nodes(l1, l2, handler, f);
+      },
+      [&](avl_tree &tree, Fork f) {
+        right = tree.symmetric_difference_nodes(r1, r2, handler, f);
+      });
+
+  if (found == nullptr)
+    return join_nodes(left, pivot, right);
+
+  handler(static_cast<pointer>(pivot));
+  handler(static_cast<pointer>(found));
+  return join2_nodes(left, right);
+}
+
+template <class T, class Compare, class Node>
+template <class Counter, class Func, class Fork>
+void avl_tree<T, Compare, Node>::set_union_impl(avl_tree &other, Func &handler, Fork fork) {
+  assert(&other != this);
+  Counter dropped{0};
+  auto    drop = [&](pointer node) {
+    ++dropped;
+    handler(node);
+  };
+
+  size_type size = (mSize == unknown_size || other.mSize == unknown_size)
+                       ? unknown_size
+                       : mSize + other.mSize;
+  subtree   root = union_nodes(whole(), other.whole(), drop, fork);
+
+  assign_root(root.root, (size == unknown_size) ? size : size - dropped);
+  other.reset();
+}
+
+template <class T, class Compare, class Node>
+template <class Counter, class Func, class Fork>
+void avl_tree<T, Compare, Node>::set_intersection_impl(const avl_tree &other,
+                                                       Func           &handler,
+                                                       Fork            fork) {
+  assert(&other != this);
+  Counter dropped{0};
+  auto    drop = [&](pointer node) {
+    ++dropped;
+    handler(node);
+  };
+
+  size_type size = mSize;
+  subtree   root = intersection_nodes(whole(), other.mValue.first(), drop, fork);
+
+  assign_root(root.root, (size == unknown_size) ? size : size - dropped);
+}
+
+template <class T, class Compare, class Node>
+template <class Counter, class Func, class Fork>
+void avl_tree<T, Compare, Node>::set_difference_impl(const avl_tree &other,
+                                                     Func           &handler,
+                                                     Fork            fork) {
+  assert(&other != this);
+  Counter dropped{0};
+  auto    drop = [&](pointer node) {
+    ++dropped;
+    handler(node);
+  };
+
+  size_type size = mSize;
+  subtree   root = difference_nodes(whole(), other.mValue.first(), drop, fork);
+
+  assign_root(root.root, (size == unknown_size) ? size : size - dropped);
+}
+
+template <class T, class Compare, class Node>
+template <class Counter, class Func, class Fork>
+void avl_tree<T, Compare, Node>::set_symmetric_difference_impl(avl_tree &other,
+                                                               Func     &handler,
+                                                               Fork      fork) {
+  assert(&other != this);
+  Counter dropped{0};
+  auto    drop = [&](pointer node) {
+    ++dropped;
+    handler(node);
+  };
+
+  size_type size = (mSize == unknown_size || other.mSize == unknown_size)
+                       ? unknown_size
+                       : mSize + other.mSize;
+  subtree   root = symmetric_difference_nodes(whole(), other.whole(), drop, fork);
+
+  assign_root(root.root, (size == unknown_size) ? size : size - dropped);
+  other.reset();
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::select_node(size_type k) const noexcept -> const_node_pointer {
+  static_assert(is_ranked, "select() requires avl_rank_node.");
+  const_node_pointer node = mValue.first();
+  while (node != nullptr) {
+    size_type left = size_of(node->left());
+    if (k < left) {
       node = node->left();
-    } else if (value_comp()(*static_cast<pointer>(node), value)) {
-      node = node->right();
+    } else if (k == left) {
+      return node;
     } else {
-      return static_cast<pointer>(node);
+      k    -= left + 1;
+      node  = node->right();
     }
   }
   return nullptr;
 }
 
-template <class T, class Compare>
-auto avl_tree<T, Compare>::find(const_reference value) const noexcept -> const_pointer {
-  auto node = static_cast<const avl_node *>(root());
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::rank_impl(const Key &key) const noexcept -> size_type {
+  static_assert(is_ranked, "rank() requires avl_rank_node.");
+  size_type          rank = 0;
+  const_node_pointer node = mValue.first();
+  while (node != nullptr) {
+    if (less(*static_cast<const_pointer>(node), key)) {
+      rank += size_of(node->left()) + 1;
+      node  = node->right();
+    } else {
+      node = node->left();
+    }
+  }
+  return rank;
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::count_range_impl(const Key &lo, const Key &hi) const noexcept
+    -> size_type {
+  size_type l = rank_impl(lo);
+  size_type h = rank_impl(hi);
+  return (h > l) ? h - l : 0;
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::index_of(const_pointer obj) const noexcept -> size_type {
+  static_assert(is_ranked, "index_of() requires avl_rank_node.");
+  auto      node  = static_cast<const_node_pointer>(obj);
+  size_type index = size_of(node->left());
+  for (; node->parent() != nullptr; node = node->parent()) {
+    if (node->is_right())
+      index += size_of(node->parent()->left()) + 1;
+  }
+  assert(node == mValue.first());
+  return index;
+}
+
+template <class T, class Compare, class Node>
+template <class Func>
+auto avl_tree<T, Compare, Node>::descend_node(Func &fn) const -> const_node_pointer {
+  const_node_pointer node = mValue.first();
   while (node != nullptr) {
-    if (value_comp()(value, *static_cast<const_pointer>(node))) {
+    auto direction = fn(*static_cast<const_pointer>(node));
+    if (direction < 0)
       node = node->left();
-    } else if (value_comp()(*static_cast<const_pointer>(node), value)) {
+    else if (direction > 0)
+      node = node->right();
+    else
+      return node;
+  }
+  return nullptr;
+}
+
+template <class T, class Compare, class Node>
+template <class Key, class NodeFunc, class SubtreeFunc>
+void avl_tree<T, Compare, Node>::fold_range_impl(const Key   &lo,
+                                                 const Key   &hi,
+                                                 NodeFunc    &node_fn,
+                                                 SubtreeFunc &subtree_fn) const {
+  // Find the highest node in range, where paths to lo and hi split.
+  const_node_pointer split = mValue.first();
+  while (split != nullptr) {
+    if (less(*static_cast<const_pointer>(split), lo))
+      split = split->right();
+    else if (!less(*static_cast<const_pointer>(split), hi))
+      split = split->left();
+    else
+      break;
+  }
+
+  if (split == nullptr)
+    return;
+  node_fn(*static_cast<const_pointer>(split));
+
+  // Nodes on the path to lo that are not less than lo are in range, and so are their right
+  // subtrees.
+  for (const_node_pointer node = split->left(); node != nullptr;) {
+    if (less(*static_cast<const_pointer>(node), lo)) {
       node = node->right();
     } else {
-      return static_cast<const_pointer>(node);
+      node_fn(*static_cast<const_pointer>(node));
+      if (node->right() != nullptr)
+        subtree_fn(*static_cast<const_pointer>(node->right()));
+      node = node->left();
     }
   }
-  return nullptr;
+
+  for (const_node_pointer node = split->right(); node != nullptr;) {
+    if (less(*static_cast<const_pointer>(node), hi)) {
+      node_fn(*static_cast<const_pointer>(node));
+      if (node->left() != nullptr)
+        subtree_fn(*static_cast<const_pointer>(node->left()));
+      node = node->right();
+    } else {
+      node = node->left();
+    }
+  }
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::find(const_reference value) noexcept -> pointer {
+  return static_cast<pointer>(const_cast<node_pointer>(find_node(value)));
+}
+
+template <class T, class Compare, class Node>
+auto avl_tree<T, Compare, Node>::find(const_reference value) const noexcept -> const_pointer {
+  return static_cast<const_pointer>(find_node(value));
 }
 
-template <class T, class Compare>
+template <class T, class Compare, class Node>
 template <class Value, class Fn>
-auto avl_tree<T, Compare>::find(Fn &&fn, Value &&value) noexcept -> pointer {
-  auto node = static_cast<avl_node *>(root());
+auto avl_tree<T, Compare, Node>::find(Fn &&fn, Value &&value) noexcept -> pointer {
+  auto node = static_cast<node_pointer>(root());
   while (node != nullptr) {
     int cmp = fn(value, *static_cast<pointer>(node));
     if (cmp < 0) {
@@ -945,10 +2808,10 @@ auto avl_tree<T, Compare>::find(Fn &&fn, Value &&value) noexcept -> pointer {
   return nullptr;
 }
 
-template <class T, class Compare>
+template <class T, class Compare, class Node>
 template <class Value, class Fn>
-auto avl_tree<T, Compare>::find(Fn &&fn, Value &&value) const noexcept -> const_pointer {
-  auto node = static_cast<const avl_node *>(root());
+auto avl_tree<T, Compare, Node>::find(Fn &&fn, Value &&value) const noexcept -> const_pointer {
+  auto node = static_cast<const_node_pointer>(root());
 
   while (node != nullptr) {
     int cmp = fn(value, *static_cast<const_pointer>(node));
@@ -963,6 +2826,142 @@ auto avl_tree<T, Compare>::find(Fn &&fn, Value &&value) const noexcept -> const_
   return nullptr;
 }
 
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::find_node(const Key &key) const noexcept -> const_node_pointer {
+  auto node = static_cast<const_node_pointer>(root());
+  while (node != nullptr) {
+    int cmp = compare(key, *static_cast<const_pointer>(node));
+    if (cmp < 0) {
+      node = node->left();
+    } else if (cmp > 0) {
+      node = node->right();
+    } else {
+      return node;
+    }
+  }
+  return nullptr;
+}
+
+template <class T, class Compare, class Node>
+template <class Key, class Pointer>
+void avl_tree<T, Compare, Node>::find_batch_impl(const Key *keys,
+                                                 size_type  n,
+                                                 Pointer   *out) const noexcept {
+  const_node_pointer nodes[find_batch_width];
+  for (size_type first = 0; first < n; first += find_batch_width) {
+    size_type count   = std::min(n - first, find_batch_width);
+    size_type pending = (mValue.first() == nullptr) ? 0 : count;
+    for (size_type i = 0; i < count; ++i) {
+      nodes[i]       = mValue.first();
+      out[first + i] = nullptr;
+    }
+
+    while (pending != 0) {
+      for (size_type i = 0; i < count; ++i) {
+        const_node_pointer node = nodes[i];
+        if (node == nullptr)
+          continue;
+
+        int cmp = compare(keys[first + i], *static_cast<const_pointer>(node));
+        if (cmp == 0) {
+          out[first + i] = const_cast<Pointer>(static_cast<const_pointer>(node));
+          node           = nullptr;
+        } else {
+          node = (cmp < 0) ? node->left() : node->right();
+        }
+
+        if (node == nullptr)
+          pending -= 1;
+        else
+          avl_tree_detail::prefetch(node);
+        nodes[i] = node;
+      }
+    }
+  }
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::lower_bound_node(const Key &key) const noexcept
+    -> const_node_pointer {
+  auto               node   = static_cast<const_node_pointer>(root());
+  const_node_pointer result = nullptr;
+  while (node != nullptr) {
+    if (less(*static_cast<const_pointer>(node), key)) {
+      node = node->right();
+    } else {
+      result = node;
+      node   = node->left();
+    }
+  }
+  return result;
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::upper_bound_node(const Key &key) const noexcept
+    -> const_node_pointer {
+  auto               node   = static_cast<const_node_pointer>(root());
+  const_node_pointer result = nullptr;
+  while (node != nullptr) {
+    if (less(key, *static_cast<const_pointer>(node))) {
+      result = node;
+      node   = node->left();
+    } else {
+      node = node->right();
+    }
+  }
+  return result;
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::floor_node(const Key &key) const noexcept -> const_node_pointer {
+  auto               node   = static_cast<const_node_pointer>(root());
+  const_node_pointer result = nullptr;
+  while (node != nullptr) {
+    if (less(key, *static_cast<const_pointer>(node))) {
+      node = node->left();
+    } else {
+      result = node;
+      node   = node->right();
+    }
+  }
+  return result;
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::nearest_node(const Key &key) const noexcept -> const_node_pointer {
+  auto               node   = static_cast<const_node_pointer>(root());
+  const_node_pointer result = nullptr;
+  while (node != nullptr) {
+    int cmp = compare(key, *static_cast<const_pointer>(node));
+    result  = node;
+    if (cmp < 0) {
+      node = node->left();
+    } else if (cmp > 0) {
+      node = node->right();
+    } else {
+      break;
+    }
+  }
+  return result;
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto avl_tree<T, Compare, Node>::count_impl(const Key &key) const noexcept -> size_type {
+  const_node_pointer first = lower_bound_node(key);
+  const_node_pointer last  = upper_bound_node(key);
+
+  size_type n = 0;
+  for (; first != last; first = first->next())
+    n += 1;
+  return n;
+}
+
 } // namespace tinystl
 
 #endif // TINYSTL_AVL_TREE_H
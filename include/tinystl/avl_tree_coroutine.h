@@ -0,0 +1,283 @@
+/// 基于C++20协程的avl_tree交错查找。
+///
+/// 在远大于缓存的树中，find的耗时主要来自沿指针向下查找时的缓存缺失。coro_find与coro_lower_bound
+/// 在预取下一个节点之后挂起，由调度器轮流恢复多个查找，使不同查找的缓存缺失相互重叠。与find_batch
+/// 相比，协程可以与其他同样需要挂起的工作交错执行，而不需要手写状态机。
+///
+/// 只有编译器支持协程（定义了__cpp_impl_coroutine）时才可用，avl_tree本身仍然只需要C++14。
+/// 协程帧由线程局部的空闲链表复用，稳定运行时不会分配堆内存。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// tinystl::interleave<16>(keys.size(),
+///                         [&](size_t i) { return tinystl::coro_find(tree, keys[i]); },
+///                         [&](size_t i, MyClass *found) { ... });
+/// ```
+///
+
+#ifndef TINYSTL_AVL_TREE_COROUTINE_H
+#define TINYSTL_AVL_TREE_COROUTINE_H
+
+#include <tinystl/avl_tree.h>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace tinystl {
+
+namespace avl_coroutine_detail {
+
+/// Thread local free list of coroutine frames. Frames of lookups have the same size, so they are
+/// recycled instead of being allocated for every lookup.
+class frame_pool {
+public:
+  static constexpr size_t block_size = 256;
+
+  static void *allocate(size_t size) {
+    if (size > block_size)
+      return ::operator new(size);
+
+    block *&head = instance().mHead;
+    if (head == nullptr)
+      return ::operator new(block_size);
+
+    block *result = head;
+    head          = head->next;
+    return result;
+  }
+
+  static void deallocate(void *ptr, size_t size) noexcept {
+    if (size > block_size) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    block *&head = instance().mHead;
+    auto    node = static_cast<block *>(ptr);
+    node->next   = head;
+    head         = node;
+  }
+
+private:
+  struct block {
+    block *next;
+  };
+
+  frame_pool() noexcept = default;
+
+  ~frame_pool() {
+    while (mHead != nullptr) {
+      block *next = mHead->next;
+      ::operator delete(mHead);
+      mHead = next;
+    }
+  }
+
+  static frame_pool &instance() noexcept {
+    static thread_local frame_pool pool;
+    return pool;
+  }
+
+  block *mHead = nullptr;
+};
+
+/// Prefetch node and suspend, so that the node is hopefully in cache when the lookup is resumed.
+struct prefetch_awaiter {
+  const void *node;
+
+  bool await_ready() const noexcept {
+    avl_tree_detail::prefetch(node);
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<>) const noexcept {}
+  void await_resume() const noexcept {}
+};
+
+} // namespace avl_coroutine_detail
+
+/// A suspended lookup that finally returns a pointer to T. It does not run until resumed.
+template <class T>
+class avl_lookup {
+public:
+  struct promise_type {
+    T *mResult = nullptr;
+
+    avl_lookup get_return_object() noexcept {
+      return avl_lookup(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    std::suspend_always final_suspend() const noexcept { return {}; }
+
+    void return_value(T *result) noexcept { mResult = result; }
+    void unhandled_exception() const noexcept { std::terminate(); }
+
+    static void *operator new(size_t size) {
+      return avl_coroutine_detail::frame_pool::allocate(size);
+    }
+
+    static void operator delete(void *ptr, size_t size) noexcept {
+      avl_coroutine_detail::frame_pool::deallocate(ptr, size);
+    }
+  };
+
+  avl_lookup() noexcept = default;
+
+  avl_lookup(avl_lookup &&other) noexcept : mHandle(std::exchange(other.mHandle, nullptr)) {}
+
+  avl_lookup &operator=(avl_lookup &&other) noexcept {
+    if (this != &other) {
+      reset();
+      mHandle = std::exchange(other.mHandle, nullptr);
+    }
+    return *this;
+  }
+
+  ~avl_lookup() { reset(); }
+
+  /// Whether this object holds a lookup.
+  explicit operator bool() const noexcept { return static_cast<bool>(mHandle); }
+
+  bool done() const noexcept { return mHandle.done(); }
+
+  /// Run the lookup until it prefetches the next node or finishes.
+  void resume() const { mHandle.resume(); }
+
+  /// Result of a finished lookup.
+  T *result() const noexcept { return mHandle.promise().mResult; }
+
+  /// Run the lookup to the end and return its result.
+  T *get() const {
+    while (!done())
+      resume();
+    return result();
+  }
+
+private:
+  explicit avl_lookup(std::coroutine_handle<promise_type> handle) noexcept : mHandle(handle) {}
+
+  void reset() noexcept {
+    if (mHandle)
+      mHandle.destroy();
+    mHandle = nullptr;
+  }
+
+  std::coroutine_handle<promise_type> mHandle;
+};
+
+namespace avl_coroutine_detail {
+
+/// value_type of Tree, which is const if Tree is const.
+template <class Tree>
+using value_t = typename std::conditional<std::is_const<Tree>::value,
+                                          const typename Tree::value_type,
+                                          typename Tree::value_type>::type;
+
+} // namespace avl_coroutine_detail
+
+/// Coroutine version of avl_tree::find(). key is referenced by the lookup and must outlive it.
+/// Compare should accept key and value_type in both orders, as in heterogeneous find().
+template <class Tree, class Key>
+avl_lookup<avl_coroutine_detail::value_t<Tree>> coro_find(Tree &tree, const Key &key) {
+  using pointer = avl_coroutine_detail::value_t<Tree> *;
+
+  auto    comp = tree.key_comp();
+  pointer node = tree.root();
+  while (node != nullptr) {
+    int cmp = avl_tree_detail::compare(
+        comp, key, *node, std::integral_constant<bool, std::remove_const_t<Tree>::is_three_way>());
+    if (cmp == 0)
+      co_return node;
+
+    auto next = (cmp < 0) ? node->left() : node->right();
+    if (next == nullptr)
+      break;
+
+    co_await avl_coroutine_detail::prefetch_awaiter{next};
+    node = static_cast<pointer>(next);
+  }
+  co_return nullptr;
+}
+
+/// Coroutine version of avl_tree::lower_bound(). Return the first node not less than key, or
+/// nullptr if there is none.
+template <class Tree, class Key>
+avl_lookup<avl_coroutine_detail::value_t<Tree>> coro_lower_bound(Tree &tree, const Key &key) {
+  using pointer = avl_coroutine_detail::value_t<Tree> *;
+
+  auto    comp   = tree.key_comp();
+  pointer node   = tree.root();
+  pointer result = nullptr;
+  while (node != nullptr) {
+    auto next = node->left();
+    if (avl_tree_detail::less(
+            comp, *node, key,
+            std::integral_constant<bool, std::remove_const_t<Tree>::is_three_way>())) {
+      next = node->right();
+    } else {
+      result = node;
+    }
+
+    if (next == nullptr)
+      break;
+
+    co_await avl_coroutine_detail::prefetch_awaiter{next};
+    node = static_cast<pointer>(next);
+  }
+  co_return result;
+}
+
+/// Run count lookups with at most Width of them in flight. make(i) creates the i-th lookup, which
+/// could be any avl_lookup, including user coroutines that chase other pointers. done(i, result)
+/// is called when it finishes. In-flight lookups are resumed round-robin, and a finished one is
+/// replaced by the next lookup immediately.
+template <size_t Width = 16, class Make, class Done>
+void interleave(size_t count, Make &&make, Done &&done) {
+  using lookup_type = decltype(make(size_t(0)));
+
+  std::array<lookup_type, Width> lookups;
+  std::array<size_t, Width>      indices{};
+
+  size_t next    = 0;
+  size_t pending = 0;
+  for (size_t i = 0; i < Width && next < count; ++i, ++next, ++pending) {
+    lookups[i] = make(next);
+    indices[i] = next;
+  }
+
+  while (pending != 0) {
+    for (size_t i = 0; i < Width; ++i) {
+      lookup_type &lookup = lookups[i];
+      if (!lookup)
+        continue;
+
+      lookup.resume();
+      if (!lookup.done())
+        continue;
+
+      done(indices[i], lookup.result());
+      if (next < count) {
+        lookup     = make(next);
+        indices[i] = next++;
+      } else {
+        lookup = lookup_type();
+        pending -= 1;
+      }
+    }
+  }
+}
+
+} // namespace tinystl
+
+#endif // __cpp_impl_coroutine
+
+#endif // TINYSTL_AVL_TREE_COROUTINE_H
@@ -0,0 +1,185 @@
+/// avl_tree的并行集合运算。
+///
+/// 集合运算基于split与join：以一棵树的根节点分裂另一棵树，然后分别递归处理左右两半。左右两半互不
+/// 相关，因此可以交给不同的线程执行。这里的函数与avl_tree的同名成员函数结果相同，但最多同时使用
+/// threads个任务，节点数少于grain的子树顺序执行，避免创建任务的开销超过计算本身。
+///
+/// 任务由spawn创建：spawn(task)应当异步执行task，并返回一个可以调用wait()等待task结束的对象。
+/// 默认的thread_spawn为每个任务创建一个std::thread，也可以传入线程池等执行器。一个任务会等待它
+/// 创建的子任务，因此执行器需要能同时运行threads - 1个任务，否则可能死锁。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// tinystl::avl_tree<MyClass> lhs, rhs;
+///
+/// // 最多使用8个线程
+/// tinystl::parallel_set_union(lhs, rhs, [](MyClass *p) { delete p; }, 8);
+///
+/// // 使用std::async执行任务
+/// auto spawn = [](std::function<void()> task) { return std::async(std::launch::async, task); };
+/// tinystl::parallel_set_union(lhs, rhs, [](MyClass *p) { delete p; }, 8, spawn);
+/// ```
+///
+/// 注意，threads大于1时handler与Compare可能被并发调用。
+///
+
+#ifndef TINYSTL_AVL_TREE_PARALLEL_H
+#define TINYSTL_AVL_TREE_PARALLEL_H
+
+#include <tinystl/avl_tree.h>
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+
+namespace tinystl {
+
+/// Run each task on a new std::thread.
+struct thread_spawn {
+  class handle {
+  public:
+    explicit handle(std::thread thread) noexcept : mThread(std::move(thread)) {}
+
+    void wait() { mThread.join(); }
+
+  private:
+    std::thread mThread;
+  };
+
+  template <class Task>
+  handle operator()(Task &&task) const {
+    return handle(std::thread(std::forward<Task>(task)));
+  }
+};
+
+namespace avl_tree_detail {
+
+/// Subtrees with less than about default_grain nodes are processed sequentially.
+constexpr size_t default_grain = 1 << 16;
+
+/// Fork both halves of a set operation while tasks remain and the subtrees are high enough.
+template <class Spawn>
+struct parallel_fork {
+  Spawn   *spawn;
+  unsigned tasks;
+  size_t   height;
+
+  static parallel_fork make(Spawn &spawn, unsigned tasks, size_t grain) noexcept {
+    // Subtree sizes are not stored, so grain is turned into a height.
+    size_t height = 0;
+    while (height + 1 < sizeof(size_t) * 8 && (size_t(1) << height) < grain)
+      height += 1;
+    return {&spawn, tasks, height};
+  }
+
+  template <class Tree, class Left, class Right>
+  void operator()(Tree &tree, size_t subtree_height, Left &&left, Right &&right) const {
+    if (tasks <= 1 || subtree_height < height) {
+      left(tree, *this);
+      right(tree, *this);
+      return;
+    }
+
+    parallel_fork lhs{spawn, tasks / 2, height};
+    parallel_fork rhs{spawn, tasks - lhs.tasks, height};
+
+    // Root of tree is used as scratch by join_nodes(), so the new task needs its own tree.
+    auto handle = (*spawn)([&]() {
+      Tree scratch(tree.key_comp());
+      left(scratch, lhs);
+    });
+
+    try {
+      right(tree, rhs);
+    } catch (...) {
+      handle.wait();
+      throw;
+    }
+    handle.wait();
+  }
+};
+
+template <class Tree>
+struct parallel_set_operations {
+  using counter = std::atomic<typename Tree::size_type>;
+
+  template <class Func, class Fork>
+  static void set_union(Tree &tree, Tree &other, Func &handler, Fork fork) {
+    tree.template set_union_impl<counter>(other, handler, fork);
+  }
+
+  template <class Func, class Fork>
+  static void set_intersection(Tree &tree, const Tree &other, Func &handler, Fork fork) {
+    tree.template set_intersection_impl<counter>(other, handler, fork);
+  }
+
+  template <class Func, class Fork>
+  static void set_difference(Tree &tree, const Tree &other, Func &handler, Fork fork) {
+    tree.template set_difference_impl<counter>(other, handler, fork);
+  }
+
+  template <class Func, class Fork>
+  static void set_symmetric_difference(Tree &tree, Tree &other, Func &handler, Fork fork) {
+    tree.template set_symmetric_difference_impl<counter>(other, handler, fork);
+  }
+};
+
+} // namespace avl_tree_detail
+
+/// Parallel version of avl_tree::set_union().
+template <class T, class Compare, class Node, class Func, class Spawn = thread_spawn>
+void parallel_set_union(avl_tree<T, Compare, Node> &tree,
+                        avl_tree<T, Compare, Node> &other,
+                        Func                      &&handler,
+                        unsigned                    threads,
+                        Spawn                       spawn = Spawn(),
+                        size_t                      grain = avl_tree_detail::default_grain) {
+  using operations = avl_tree_detail::parallel_set_operations<avl_tree<T, Compare, Node>>;
+  operations::set_union(tree, other, handler,
+                        avl_tree_detail::parallel_fork<Spawn>::make(spawn, threads, grain));
+}
+
+/// Parallel version of avl_tree::set_intersection().
+template <class T, class Compare, class Node, class Func, class Spawn = thread_spawn>
+void parallel_set_intersection(avl_tree<T, Compare, Node>       &tree,
+                               const avl_tree<T, Compare, Node> &other,
+                               Func                            &&handler,
+                               unsigned                          threads,
+                               Spawn                             spawn = Spawn(),
+                               size_t grain = avl_tree_detail::default_grain) {
+  using operations = avl_tree_detail::parallel_set_operations<avl_tree<T, Compare, Node>>;
+  operations::set_intersection(tree, other, handler,
+                               avl_tree_detail::parallel_fork<Spawn>::make(spawn, threads, grain));
+}
+
+/// Parallel version of avl_tree::set_difference().
+template <class T, class Compare, class Node, class Func, class Spawn = thread_spawn>
+void parallel_set_difference(avl_tree<T, Compare, Node>       &tree,
+                             const avl_tree<T, Compare, Node> &other,
+                             Func                            &&handler,
+                             unsigned                          threads,
+                             Spawn                             spawn = Spawn(),
+                             size_t grain = avl_tree_detail::default_grain) {
+  using operations = avl_tree_detail::parallel_set_operations<avl_tree<T, Compare, Node>>;
+  operations::set_difference(tree, other, handler,
+                             avl_tree_detail::parallel_fork<Spawn>::make(spawn, threads, grain));
+}
+
+/// Parallel version of avl_tree::set_symmetric_difference().
+template <class T, class Compare, class Node, class Func, class Spawn = thread_spawn>
+void parallel_set_symmetric_difference(avl_tree<T, Compare, Node> &tree,
+                                       avl_tree<T, Compare, Node> &other,
+                                       Func                      &&handler,
+                                       unsigned                    threads,
+                                       Spawn                       spawn = Spawn(),
+                                       size_t grain = avl_tree_detail::default_grain) {
+  using operations = avl_tree_detail::parallel_set_operations<avl_tree<T, Compare, Node>>;
+  operations::set_symmetric_difference(
+      tree, other, handler, avl_tree_detail::parallel_fork<Spawn>::make(spawn, threads, grain));
+}
+
+} // namespace tinystl
+
+#endif // TINYSTL_AVL_TREE_PARALLEL_H
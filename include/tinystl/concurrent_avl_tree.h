@@ -0,0 +1,938 @@
+/// 基于细粒度锁的并发AVL Tree。
+///
+/// 实现参考Bronson等人的论文：A Practical Concurrent Binary Search Tree (PPoPP 2010)。
+///
+/// 每个节点带有一个版本号与一个自旋锁：
+/// 1. 查找不加锁，沿路径逐层向下，每进入一个子节点前都会重新检查父节点的版本号（hand-over-hand
+///    optimistic validation）。旋转时被移到下方的节点会修改版本号，正在经过它的查找会从上一层重试。
+/// 2. 插入与删除只锁住需要修改的节点。删除有两个子节点的节点时，只清空其值，使其成为路由节点，
+///    之后在再平衡时如果它的子节点少于两个再将其移除。
+/// 3. 平衡是宽松的：修改节点的线程负责沿着路径修复高度，旋转只在局部加锁后进行，并且锁总是自上而下
+///    获取，不会死锁。
+///
+/// 与avl_tree不同，这里的节点由树内部分配。树中保存的是键到用户对象指针的映射，用户对象本身仍然
+/// 由使用者管理。被移除的内部节点可能仍有查找正在访问，因此由树自带的epoch_domain延迟回收：
+/// 每个线程持有一个epoch_participant，查找时通过epoch_guard进入临界区，插入与删除在内部进入临界区，
+/// 并将移除的节点交给传入的epoch_participant，没有线程可能访问它之后再释放。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// tinystl::concurrent_avl_tree<int64_t, MyClass> tree;
+///
+/// // 每个线程
+/// tinystl::epoch_participant local(tree.domain());
+///
+/// tree.insert_unique(local, key, &object);
+/// MyClass *q = tree.erase(local, key);
+/// {
+///   tinystl::epoch_guard guard(local);
+///   MyClass *p = tree.find(guard, key);
+/// }
+/// ```
+///
+/// 注意，所有epoch_participant都需要在树之前析构。
+///
+
+#ifndef TINYSTL_CONCURRENT_AVL_TREE_H
+#define TINYSTL_CONCURRENT_AVL_TREE_H
+
+#include <tinystl/avl_tree.h>
+#include <tinystl/epoch_reclamation.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace tinystl {
+
+namespace concurrent_avl_detail {
+
+/// Test and test-and-set lock. Critical sections in concurrent_avl_tree are a few pointer writes.
+class spinlock {
+public:
+  void lock() noexcept {
+    for (unsigned spins = 0; mLocked.exchange(true, std::memory_order_acquire); ++spins) {
+      while (mLocked.load(std::memory_order_relaxed)) {
+        if (++spins % 64 == 0)
+          std::this_thread::yield();
+      }
+    }
+  }
+
+  void unlock() noexcept { mLocked.store(false, std::memory_order_release); }
+
+private:
+  std::atomic<bool> mLocked{false};
+};
+
+// Version of a node. It is odd once the node is unlinked, and the changing bit is set while the
+// node is being moved down by a rotation.
+constexpr std::uint64_t unlinked_version = 1;
+constexpr std::uint64_t changing_bit     = 2;
+constexpr std::uint64_t version_step     = 4;
+
+inline bool is_changing(std::uint64_t version) noexcept { return (version & changing_bit) != 0; }
+
+inline bool is_unlinked(std::uint64_t version) noexcept { return version == unlinked_version; }
+
+inline bool is_changing_or_unlinked(std::uint64_t version) noexcept {
+  return (version & (changing_bit | unlinked_version)) != 0;
+}
+
+/// Links, version and value of a node. The root holder has no key, and the root of the tree is its
+/// right child.
+template <class T>
+struct node_base {
+  std::atomic<node_base *>   parent{nullptr};
+  std::atomic<node_base *>   left{nullptr};
+  std::atomic<node_base *>   right{nullptr};
+  std::atomic<std::uint64_t> version{0};
+  std::atomic<int>           height{1};
+  // nullptr if this is a routing node, whose value is erased.
+  std::atomic<T *> value{nullptr};
+  spinlock         lock;
+
+  std::atomic<node_base *> &child(int direction) noexcept {
+    return (direction < 0) ? left : right;
+  }
+};
+
+template <class Key, class T>
+struct node : node_base<T> {
+  const Key key;
+
+  node(const Key &k, T *v, node_base<T> *p) : key(k) {
+    this->value.store(v, std::memory_order_relaxed);
+    this->parent.store(p, std::memory_order_relaxed);
+  }
+};
+
+} // namespace concurrent_avl_detail
+
+/// Concurrent map from Key to T *. insert_unique(), erase() and find() could be called from any
+/// number of threads at the same time, each with its own participant of domain(). Values must not
+/// be nullptr.
+template <class Key, class T, class Compare = std::less<Key>>
+class concurrent_avl_tree {
+public:
+  using key_type    = Key;
+  using mapped_type = T;
+  using size_type   = size_t;
+  using key_compare = Compare;
+  using pointer     = T *;
+
+  concurrent_avl_tree() = default;
+
+  explicit concurrent_avl_tree(const Compare &cmp) : mCompare(cmp) {}
+
+  concurrent_avl_tree(const concurrent_avl_tree &)            = delete;
+  concurrent_avl_tree &operator=(const concurrent_avl_tree &) = delete;
+
+  ~concurrent_avl_tree();
+
+  /// Domain that searches pin and removed internal nodes are retired to.
+  epoch_domain &domain() noexcept { return mDomain; }
+
+  /// Number of keys. It is exact only if no update is running.
+  size_type size() const noexcept { return mSize.load(std::memory_order_relaxed); }
+  bool      empty() const noexcept { return size() == 0; }
+
+  /// Map key to value if key is not present. Return false if key is already present.
+  bool insert_unique(epoch_participant &local, const Key &key, pointer value) {
+    assert(value != nullptr);
+    return update(local, key, value) == nullptr;
+  }
+
+  /// Remove key and return its value. Return nullptr if key is not present. Internal nodes removed
+  /// from the tree are retired to local.
+  pointer erase(epoch_participant &local, const Key &key) { return update(local, key, nullptr); }
+
+  /// Return value of key, or nullptr if key is not present. It never blocks unless the search
+  /// meets a rotation in progress. guard must pin a participant of domain().
+  pointer find(const epoch_guard &guard, const Key &key) const noexcept;
+
+  bool contains(const epoch_guard &guard, const Key &key) const noexcept {
+    return find(guard, key) != nullptr;
+  }
+
+private:
+  using node_base = concurrent_avl_detail::node_base<T>;
+  using node_type = concurrent_avl_detail::node<Key, T>;
+
+  static constexpr int unlink_required    = -1;
+  static constexpr int rebalance_required = -2;
+  static constexpr int nothing_required   = -3;
+
+  static constexpr bool is_three_way =
+      avl_tree_detail::is_three_way_compare<Compare, Key, Key>::value;
+
+  int compare(const Key &key, const node_base *node) const noexcept {
+    return avl_tree_detail::compare(mCompare, key, static_cast<const node_type *>(node)->key,
+                                    std::integral_constant<bool, is_three_way>());
+  }
+
+  static int height(const node_base *node) noexcept {
+    return (node == nullptr) ? 0 : node->height.load();
+  }
+
+  /// Wait until a rotation moving node down finishes.
+  static void wait_until_changed(const node_base *node, std::uint64_t version) noexcept {
+    if (!concurrent_avl_detail::is_changing(version))
+      return;
+    for (unsigned spins = 1; node->version.load() == version; ++spins) {
+      if (spins % 64 == 0)
+        std::this_thread::yield();
+    }
+  }
+
+  /// Return false if the search should be retried from parent of node.
+  bool attempt_find(const Key     &key,
+                    node_base     *node,
+                    int            direction,
+                    std::uint64_t  version,
+                    pointer       &result) const noexcept;
+
+  /// Insert key if value is not nullptr, otherwise erase key. Return the previous value.
+  pointer update(epoch_participant &local, const Key &key, pointer value);
+
+  /// Return false if the update should be retried from parent of node.
+  bool attempt_update(epoch_participant &local,
+                      const Key         &key,
+                      pointer            value,
+                      node_base         *parent,
+                      node_base         *node,
+                      std::uint64_t      version,
+                      pointer           &result);
+  bool attempt_node_update(epoch_participant &local,
+                           pointer            value,
+                           node_base         *parent,
+                           node_base         *node,
+                           pointer           &result);
+
+  /// Splice node out of the tree. Both parent and node should be locked and node should have at
+  /// most one child. The caller retires node after releasing the locks.
+  bool attempt_unlink(node_base *parent, node_base *node) noexcept;
+
+  // Rebalancing. A function returns the next node to fix, or nullptr if nothing is left. Functions
+  // with locked parameters expect those nodes to be locked by the caller.
+
+  static int node_condition(node_base *node) noexcept;
+  void       fix_height_and_rebalance(epoch_participant &local, node_base *node);
+  node_base *fix_height_locked(node_base *node) noexcept;
+  node_base *rebalance_locked(node_base *parent, node_base *node, node_base *&unlinked) noexcept;
+  node_base *rebalance_to_right(node_base *parent, node_base *node, node_base *left, int hr)
+      noexcept;
+  node_base *rebalance_to_left(node_base *parent, node_base *node, node_base *right, int hl)
+      noexcept;
+  node_base *rotate_right(node_base *parent,
+                          node_base *node,
+                          node_base *left,
+                          int        hr,
+                          int        hll,
+                          node_base *left_right,
+                          int        hlr) noexcept;
+  node_base *rotate_left(node_base *parent,
+                         node_base *node,
+                         int        hl,
+                         node_base *right,
+                         node_base *right_left,
+                         int        hrl,
+                         int        hrr) noexcept;
+  node_base *rotate_right_over_left(node_base *parent,
+                                    node_base *node,
+                                    node_base *left,
+                                    int        hr,
+                                    int        hll,
+                                    node_base *left_right,
+                                    int        hlrl) noexcept;
+  node_base *rotate_left_over_right(node_base *parent,
+                                    node_base *node,
+                                    int        hl,
+                                    node_base *right,
+                                    node_base *right_left,
+                                    int        hrr,
+                                    int        hrlr) noexcept;
+
+  /// Free an unlinked node once no search could be visiting it.
+  static void retire(epoch_participant &local, node_base *node) {
+    local.retire(static_cast<node_type *>(node));
+  }
+
+  static void destroy(node_base *node) noexcept;
+
+  epoch_domain           mDomain;
+  Compare                mCompare;
+  mutable node_base      mHolder;
+  std::atomic<size_type> mSize{0};
+};
+
+template <class Key, class T, class Compare>
+concurrent_avl_tree<Key, T, Compare>::~concurrent_avl_tree() {
+  destroy(mHolder.right.load());
+}
+
+template <class Key, class T, class Compare>
+void concurrent_avl_tree<Key, T, Compare>::destroy(node_base *node) noexcept {
+  while (node != nullptr) {
+    destroy(node->left.load(std::memory_order_relaxed));
+    node_base *right = node->right.load(std::memory_order_relaxed);
+    delete static_cast<node_type *>(node);
+    node = right;
+  }
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::find(const epoch_guard &guard,
+                                                const Key         &key) const noexcept -> pointer {
+  assert(&guard.participant().domain() == &mDomain && guard.participant().pinned());
+  (void)guard;
+
+  pointer result = nullptr;
+  while (!attempt_find(key, &mHolder, 1, mHolder.version.load(), result)) {
+  }
+  return result;
+}
+
+template <class Key, class T, class Compare>
+bool concurrent_avl_tree<Key, T, Compare>::attempt_find(const Key     &key,
+                                                        node_base     *node,
+                                                        int            direction,
+                                                        std::uint64_t  version,
+                                                        pointer       &result) const noexcept {
+  using namespace concurrent_avl_detail;
+
+  for (;;) {
+    node_base *child = node->child(direction).load();
+    if (child == nullptr) {
+      if (node->version.load() != version)
+        return false;
+      result = nullptr;
+      return true;
+    }
+
+    int cmp = compare(key, child);
+    if (cmp == 0) {
+      result = child->value.load();
+      return true;
+    }
+
+    // Make sure that child is still the right subtree to search before going down.
+    std::uint64_t child_version = child->version.load();
+    if (is_changing_or_unlinked(child_version)) {
+      wait_until_changed(child, child_version);
+      if (node->version.load() != version)
+        return false;
+    } else if (child != node->child(direction).load()) {
+      if (node->version.load() != version)
+        return false;
+    } else {
+      if (node->version.load() != version)
+        return false;
+      if (attempt_find(key, child, cmp, child_version, result))
+        return true;
+    }
+  }
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::update(epoch_participant &local,
+                                                  const Key         &key,
+                                                  pointer            value) -> pointer {
+  using namespace concurrent_avl_detail;
+  assert(&local.domain() == &mDomain);
+
+  // Searches for the node to update follow links without locks as well.
+  epoch_guard guard(local);
+  for (;;) {
+    node_base *root = mHolder.right.load();
+    if (root == nullptr) {
+      if (value == nullptr)
+        return nullptr;
+
+      auto                        node = new node_type(key, value, &mHolder);
+      std::lock_guard<spinlock>   guard(mHolder.lock);
+      if (mHolder.right.load() == nullptr) {
+        mHolder.right.store(node);
+        mHolder.height.store(2);
+        mSize.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      delete node;
+    } else {
+      std::uint64_t version = root->version.load();
+      pointer       result  = nullptr;
+      if (is_changing_or_unlinked(version)) {
+        wait_until_changed(root, version);
+      } else if (root == mHolder.right.load() &&
+                 attempt_update(local, key, value, &mHolder, root, version, result)) {
+        return result;
+      }
+    }
+  }
+}
+
+template <class Key, class T, class Compare>
+bool concurrent_avl_tree<Key, T, Compare>::attempt_update(epoch_participant &local,
+                                                          const Key         &key,
+                                                          pointer            value,
+                                                          node_base         *parent,
+                                                          node_base         *node,
+                                                          std::uint64_t      version,
+                                                          pointer           &result) {
+  using namespace concurrent_avl_detail;
+
+  int cmp = compare(key, node);
+  if (cmp == 0)
+    return attempt_node_update(local, value, parent, node, result);
+
+  for (;;) {
+    node_base *child = node->child(cmp).load();
+    if (node->version.load() != version)
+      return false;
+
+    if (child == nullptr) {
+      // Key is not present.
+      if (value == nullptr) {
+        result = nullptr;
+        return true;
+      }
+
+      auto leaf     = new node_type(key, value, node);
+      bool inserted = false;
+      {
+        std::lock_guard<spinlock> guard(node->lock);
+        if (node->version.load() != version) {
+          delete leaf;
+          return false;
+        }
+        if (node->child(cmp).load() == nullptr) {
+          node->child(cmp).store(leaf);
+          inserted = true;
+        }
+      }
+
+      if (inserted) {
+        mSize.fetch_add(1, std::memory_order_relaxed);
+        fix_height_and_rebalance(local, node);
+        result = nullptr;
+        return true;
+      }
+      // Another thread linked a child first. Search it again.
+      delete leaf;
+    } else {
+      std::uint64_t child_version = child->version.load();
+      if (is_changing_or_unlinked(child_version)) {
+        wait_until_changed(child, child_version);
+      } else if (child != node->child(cmp).load()) {
+        continue;
+      } else {
+        if (node->version.load() != version)
+          return false;
+        if (attempt_update(local, key, value, node, child, child_version, result))
+          return true;
+      }
+    }
+  }
+}
+
+template <class Key, class T, class Compare>
+bool concurrent_avl_tree<Key, T, Compare>::attempt_node_update(epoch_participant &local,
+                                                               pointer            value,
+                                                               node_base         *parent,
+                                                               node_base         *node,
+                                                               pointer           &result) {
+  using namespace concurrent_avl_detail;
+
+  if (value == nullptr) {
+    if (node->value.load() == nullptr) {
+      result = nullptr;
+      return true;
+    }
+
+    // Nodes with at most one child are spliced out instead of becoming routing nodes, which needs
+    // parent to be locked as well.
+    if (node->left.load() == nullptr || node->right.load() == nullptr) {
+      node_base *damaged;
+      {
+        std::lock_guard<spinlock> parent_guard(parent->lock);
+        if (is_unlinked(parent->version.load()) || node->parent.load() != parent)
+          return false;
+
+        {
+          std::lock_guard<spinlock> node_guard(node->lock);
+          pointer                   previous = node->value.load();
+          if (previous == nullptr) {
+            result = nullptr;
+            return true;
+          }
+          if (!attempt_unlink(parent, node))
+            return false;
+          result = previous;
+        }
+        damaged = fix_height_locked(parent);
+      }
+
+      mSize.fetch_sub(1, std::memory_order_relaxed);
+      retire(local, node);
+      fix_height_and_rebalance(local, damaged);
+      return true;
+    }
+  }
+
+  std::lock_guard<spinlock> guard(node->lock);
+  if (is_unlinked(node->version.load()))
+    return false;
+
+  pointer previous = node->value.load();
+  if (value != nullptr) {
+    // Insert into a routing node.
+    result = previous;
+    if (previous == nullptr) {
+      node->value.store(value);
+      mSize.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  result = previous;
+  if (previous == nullptr)
+    return true;
+  // Children might have been removed since the check above, then node should be spliced out.
+  if (node->left.load() == nullptr || node->right.load() == nullptr)
+    return false;
+  node->value.store(nullptr);
+  mSize.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+template <class Key, class T, class Compare>
+bool concurrent_avl_tree<Key, T, Compare>::attempt_unlink(node_base *parent,
+                                                          node_base *node) noexcept {
+  using namespace concurrent_avl_detail;
+  assert(!is_unlinked(parent->version.load()));
+
+  node_base *parent_left  = parent->left.load();
+  node_base *parent_right = parent->right.load();
+  if (parent_left != node && parent_right != node)
+    return false;
+
+  node_base *left  = node->left.load();
+  node_base *right = node->right.load();
+  if (left != nullptr && right != nullptr)
+    return false;
+
+  node_base *splice = (left != nullptr) ? left : right;
+  if (parent_left == node)
+    parent->left.store(splice);
+  else
+    parent->right.store(splice);
+  if (splice != nullptr)
+    splice->parent.store(parent);
+
+  node->version.store(unlinked_version);
+  node->value.store(nullptr);
+  return true;
+}
+
+template <class Key, class T, class Compare>
+int concurrent_avl_tree<Key, T, Compare>::node_condition(node_base *node) noexcept {
+  node_base *left  = node->left.load();
+  node_base *right = node->right.load();
+  if ((left == nullptr || right == nullptr) && node->value.load() == nullptr)
+    return unlink_required;
+
+  // Any thread changing node or its children is responsible for fixing it later, so a stale
+  // snapshot here is fine.
+  int h       = node->height.load();
+  int hl      = height(left);
+  int hr      = height(right);
+  int new_h   = std::max(hl, hr) + 1;
+  int balance = hl - hr;
+
+  if (balance < -1 || balance > 1)
+    return rebalance_required;
+  return (h != new_h) ? new_h : nothing_required;
+}
+
+template <class Key, class T, class Compare>
+void concurrent_avl_tree<Key, T, Compare>::fix_height_and_rebalance(epoch_participant &local,
+                                                                    node_base         *node) {
+  using namespace concurrent_avl_detail;
+
+  while (node != nullptr && node->parent.load() != nullptr) {
+    int condition = node_condition(node);
+    if (condition == nothing_required || is_unlinked(node->version.load()))
+      return;
+
+    node_base *unlinked = nullptr;
+    if (condition != unlink_required && condition != rebalance_required) {
+      std::lock_guard<spinlock> guard(node->lock);
+      node = fix_height_locked(node);
+    } else {
+      node_base                *parent = node->parent.load();
+      std::lock_guard<spinlock> parent_guard(parent->lock);
+      if (!is_unlinked(parent->version.load()) && node->parent.load() == parent) {
+        std::lock_guard<spinlock> node_guard(node->lock);
+        node = rebalance_locked(parent, node, unlinked);
+      }
+    }
+
+    if (unlinked != nullptr)
+      retire(local, unlinked);
+  }
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::fix_height_locked(node_base *node) noexcept
+    -> node_base * {
+  int condition = node_condition(node);
+  switch (condition) {
+  case rebalance_required:
+  case unlink_required:
+    return node;
+  case nothing_required:
+    return nullptr;
+  default:
+    node->height.store(condition);
+    return node->parent.load();
+  }
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::rebalance_locked(node_base  *parent,
+                                                            node_base  *node,
+                                                            node_base *&unlinked) noexcept
+    -> node_base * {
+  node_base *left  = node->left.load();
+  node_base *right = node->right.load();
+
+  if ((left == nullptr || right == nullptr) && node->value.load() == nullptr) {
+    if (!attempt_unlink(parent, node))
+      return node;
+    unlinked = node;
+    return fix_height_locked(parent);
+  }
+
+  int h       = node->height.load();
+  int hl      = height(left);
+  int hr      = height(right);
+  int new_h   = std::max(hl, hr) + 1;
+  int balance = hl - hr;
+
+  if (balance > 1)
+    return rebalance_to_right(parent, node, left, hr);
+  if (balance < -1)
+    return rebalance_to_left(parent, node, right, hl);
+  if (new_h != h) {
+    node->height.store(new_h);
+    return fix_height_locked(parent);
+  }
+  return nullptr;
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::rebalance_to_right(node_base *parent,
+                                                              node_base *node,
+                                                              node_base *left,
+                                                              int        hr) noexcept
+    -> node_base * {
+  using namespace concurrent_avl_detail;
+
+  std::lock_guard<spinlock> left_guard(left->lock);
+  int                       hl = left->height.load();
+  if (hl - hr <= 1)
+    return node;
+
+  node_base *left_right = left->right.load();
+  int        hll        = height(left->left.load());
+  int        hlr        = height(left_right);
+  if (hll >= hlr)
+    return rotate_right(parent, node, left, hr, hll, left_right, hlr);
+
+  {
+    std::lock_guard<spinlock> left_right_guard(left_right->lock);
+    hlr = left_right->height.load();
+    if (hll >= hlr)
+      return rotate_right(parent, node, left, hr, hll, left_right, hlr);
+
+    // A double rotation is done only if left would not be damaged by it. Otherwise, rebalance left
+    // first and leave node to later fixes.
+    int hlrl    = height(left_right->left.load());
+    int balance = hll - hlrl;
+    if (balance >= -1 && balance <= 1 &&
+        !((hll == 0 || hlrl == 0) && left->value.load() == nullptr))
+      return rotate_right_over_left(parent, node, left, hr, hll, left_right, hlrl);
+  }
+  return rebalance_to_left(node, left, left_right, hll);
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::rebalance_to_left(node_base *parent,
+                                                             node_base *node,
+                                                             node_base *right,
+                                                             int        hl) noexcept
+    -> node_base * {
+  using namespace concurrent_avl_detail;
+
+  std::lock_guard<spinlock> right_guard(right->lock);
+  int                       hr = right->height.load();
+  if (hl - hr >= -1)
+    return node;
+
+  node_base *right_left = right->left.load();
+  int        hrl        = height(right_left);
+  int        hrr        = height(right->right.load());
+  if (hrr >= hrl)
+    return rotate_left(parent, node, hl, right, right_left, hrl, hrr);
+
+  {
+    std::lock_guard<spinlock> right_left_guard(right_left->lock);
+    hrl = right_left->height.load();
+    if (hrr >= hrl)
+      return rotate_left(parent, node, hl, right, right_left, hrl, hrr);
+
+    int hrlr    = height(right_left->right.load());
+    int balance = hrr - hrlr;
+    if (balance >= -1 && balance <= 1 &&
+        !((hrr == 0 || hrlr == 0) && right->value.load() == nullptr))
+      return rotate_left_over_right(parent, node, hl, right, right_left, hrr, hrlr);
+  }
+  return rebalance_to_right(node, right, right_left, hrr);
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::rotate_right(node_base *parent,
+                                                        node_base *node,
+                                                        node_base *left,
+                                                        int        hr,
+                                                        int        hll,
+                                                        node_base *left_right,
+                                                        int        hlr) noexcept -> node_base * {
+  using namespace concurrent_avl_detail;
+
+  // node moves down, so searches passing through it have to retry.
+  std::uint64_t version = node->version.load();
+  node->version.store(version | changing_bit);
+
+  node_base *parent_left = parent->left.load();
+
+  node->left.store(left_right);
+  if (left_right != nullptr)
+    left_right->parent.store(node);
+
+  left->right.store(node);
+  node->parent.store(left);
+
+  if (parent_left == node)
+    parent->left.store(left);
+  else
+    parent->right.store(left);
+  left->parent.store(parent);
+
+  int new_h = std::max(hlr, hr) + 1;
+  node->height.store(new_h);
+  left->height.store(std::max(hll, new_h) + 1);
+
+  node->version.store(version + version_step);
+
+  // Fix as much as possible with the locks held.
+  int balance = hlr - hr;
+  if (balance < -1 || balance > 1)
+    return node;
+  if ((left_right == nullptr || hr == 0) && node->value.load() == nullptr)
+    return node;
+
+  balance = hll - new_h;
+  if (balance < -1 || balance > 1)
+    return left;
+  if (hll == 0 && left->value.load() == nullptr)
+    return left;
+
+  return fix_height_locked(parent);
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::rotate_left(node_base *parent,
+                                                       node_base *node,
+                                                       int        hl,
+                                                       node_base *right,
+                                                       node_base *right_left,
+                                                       int        hrl,
+                                                       int        hrr) noexcept -> node_base * {
+  using namespace concurrent_avl_detail;
+
+  std::uint64_t version = node->version.load();
+  node->version.store(version | changing_bit);
+
+  node_base *parent_left = parent->left.load();
+
+  node->right.store(right_left);
+  if (right_left != nullptr)
+    right_left->parent.store(node);
+
+  right->left.store(node);
+  node->parent.store(right);
+
+  if (parent_left == node)
+    parent->left.store(right);
+  else
+    parent->right.store(right);
+  right->parent.store(parent);
+
+  int new_h = std::max(hl, hrl) + 1;
+  node->height.store(new_h);
+  right->height.store(std::max(new_h, hrr) + 1);
+
+  node->version.store(version + version_step);
+
+  int balance = hrl - hl;
+  if (balance < -1 || balance > 1)
+    return node;
+  if ((right_left == nullptr || hl == 0) && node->value.load() == nullptr)
+    return node;
+
+  balance = hrr - new_h;
+  if (balance < -1 || balance > 1)
+    return right;
+  if (hrr == 0 && right->value.load() == nullptr)
+    return right;
+
+  return fix_height_locked(parent);
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::rotate_right_over_left(node_base *parent,
+                                                                  node_base *node,
+                                                                  node_base *left,
+                                                                  int        hr,
+                                                                  int        hll,
+                                                                  node_base *left_right,
+                                                                  int        hlrl) noexcept
+    -> node_base * {
+  using namespace concurrent_avl_detail;
+
+  std::uint64_t node_version = node->version.load();
+  std::uint64_t left_version = left->version.load();
+
+  node_base *parent_left      = parent->left.load();
+  node_base *left_right_left  = left_right->left.load();
+  node_base *left_right_right = left_right->right.load();
+  int        hlrr             = height(left_right_right);
+
+  node->version.store(node_version | changing_bit);
+  left->version.store(left_version | changing_bit);
+
+  node->left.store(left_right_right);
+  if (left_right_right != nullptr)
+    left_right_right->parent.store(node);
+
+  left->right.store(left_right_left);
+  if (left_right_left != nullptr)
+    left_right_left->parent.store(left);
+
+  left_right->left.store(left);
+  left->parent.store(left_right);
+  left_right->right.store(node);
+  node->parent.store(left_right);
+
+  if (parent_left == node)
+    parent->left.store(left_right);
+  else
+    parent->right.store(left_right);
+  left_right->parent.store(parent);
+
+  int new_h      = std::max(hlrr, hr) + 1;
+  int new_left_h = std::max(hll, hlrl) + 1;
+  node->height.store(new_h);
+  left->height.store(new_left_h);
+  left_right->height.store(std::max(new_left_h, new_h) + 1);
+
+  node->version.store(node_version + version_step);
+  left->version.store(left_version + version_step);
+
+  int balance = hlrr - hr;
+  if (balance < -1 || balance > 1)
+    return node;
+  if ((left_right_right == nullptr || hr == 0) && node->value.load() == nullptr)
+    return node;
+
+  balance = new_left_h - new_h;
+  if (balance < -1 || balance > 1)
+    return left_right;
+
+  return fix_height_locked(parent);
+}
+
+template <class Key, class T, class Compare>
+auto concurrent_avl_tree<Key, T, Compare>::rotate_left_over_right(node_base *parent,
+                                                                  node_base *node,
+                                                                  int        hl,
+                                                                  node_base *right,
+                                                                  node_base *right_left,
+                                                                  int        hrr,
+                                                                  int        hrlr) noexcept
+    -> node_base * {
+  using namespace concurrent_avl_detail;
+
+  std::uint64_t node_version  = node->version.load();
+  std::uint64_t right_version = right->version.load();
+
+  node_base *parent_left      = parent->left.load();
+  node_base *right_left_left  = right_left->left.load();
+  node_base *right_left_right = right_left->right.load();
+  int        hrll             = height(right_left_left);
+
+  node->version.store(node_version | changing_bit);
+  right->version.store(right_version | changing_bit);
+
+  node->right.store(right_left_left);
+  if (right_left_left != nullptr)
+    right_left_left->parent.store(node);
+
+  right->left.store(right_left_right);
+  if (right_left_right != nullptr)
+    right_left_right->parent.store(right);
+
+  right_left->right.store(right);
+  right->parent.store(right_left);
+  right_left->left.store(node);
+  node->parent.store(right_left);
+
+  if (parent_left == node)
+    parent->left.store(right_left);
+  else
+    parent->right.store(right_left);
+  right_left->parent.store(parent);
+
+  int new_h       = std::max(hl, hrll) + 1;
+  int new_right_h = std::max(hrlr, hrr) + 1;
+  node->height.store(new_h);
+  right->height.store(new_right_h);
+  right_left->height.store(std::max(new_h, new_right_h) + 1);
+
+  node->version.store(node_version + version_step);
+  right->version.store(right_version + version_step);
+
+  int balance = hrll - hl;
+  if (balance < -1 || balance > 1)
+    return node;
+  if ((right_left_left == nullptr || hl == 0) && node->value.load() == nullptr)
+    return node;
+
+  balance = new_right_h - new_h;
+  if (balance < -1 || balance > 1)
+    return right_left;
+
+  return fix_height_locked(parent);
+}
+
+} // namespace tinystl
+
+#endif // TINYSTL_CONCURRENT_AVL_TREE_H
@@ -0,0 +1,325 @@
+/// 基于纪元（epoch）的延迟内存回收。
+///
+/// avl_tree是侵入式的，节点被erase之后由使用者释放。如果有不加锁的读者（例如基于顺序锁的查找）
+/// 可能仍在访问被删除的节点，立即释放就会导致use-after-free。epoch_domain维护一个全局纪元：
+///
+/// 1. 读者在访问共享节点前进入临界区（pin），记录当前的全局纪元，离开时清除；
+/// 2. 写者删除节点后调用retire()，节点与删除器被放入当前线程对应纪元的回收列表；
+/// 3. 所有处于临界区的线程都已经看到当前纪元时，全局纪元才能前进。某个纪元中退休的节点，在全局纪元
+///    前进两次之后就不可能再被任何读者访问，此时调用删除器。
+///
+/// 注意，一个线程长时间停留在临界区会阻止全局纪元前进，此期间退休的节点都无法回收，
+/// 因此临界区应当尽量短。
+///
+/// 每个线程持有一个epoch_participant，回收列表按纪元分为三组循环使用，列表的容量在稳定运行后
+/// 不再增长，因此retire()不需要分配内存。删除器保存在固定大小的缓冲区中，需要可以平凡复制，
+/// 例如函数指针、std::default_delete或者只捕获少量指针与引用的lambda。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// tinystl::epoch_domain domain;
+///
+/// // 每个线程
+/// tinystl::epoch_participant local(domain);
+///
+/// // 读者
+/// {
+///   tinystl::epoch_guard guard(local);
+///   Visit shared nodes here.
+/// }
+///
+/// // 写者
+/// Unlink node from the shared structure.
+/// local.retire(node, [](MyClass *p) { delete p; });
+/// ```
+///
+
+#ifndef TINYSTL_EPOCH_RECLAMATION_H
+#define TINYSTL_EPOCH_RECLAMATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tinystl {
+
+namespace epoch_detail {
+
+/// A retired node and its deleter.
+struct retired {
+  static constexpr size_t state_size = sizeof(void *) * 2;
+
+  void *node;
+  void (*reclaim)(void *node, const void *state);
+  alignas(void *) unsigned char state[state_size];
+
+  void operator()() const { reclaim(node, state); }
+};
+
+template <class T, class Deleter>
+void invoke(void *node, const void *state) {
+  (*static_cast<const Deleter *>(state))(static_cast<T *>(node));
+}
+
+/// Nodes retired in the same epoch.
+struct bucket {
+  std::uint64_t        epoch = 0;
+  std::vector<retired> nodes;
+
+  /// Call all deleters. Capacity is kept for later epochs.
+  void reclaim() {
+    for (const retired &node : nodes)
+      node();
+    nodes.clear();
+  }
+};
+
+} // namespace epoch_detail
+
+class epoch_participant;
+
+/// Global epoch shared by a group of threads.
+class epoch_domain {
+public:
+  epoch_domain() = default;
+
+  epoch_domain(const epoch_domain &)            = delete;
+  epoch_domain &operator=(const epoch_domain &) = delete;
+
+  /// All participants should be destroyed before the domain.
+  ~epoch_domain();
+
+  std::uint64_t epoch() const noexcept { return mEpoch.load(); }
+
+  /// Advance the global epoch if every pinned participant has seen the current one. Return false if
+  /// some participant is still pinned in an older epoch.
+  bool try_advance();
+
+private:
+  friend class epoch_participant;
+
+  void join(epoch_participant *participant);
+  void leave(epoch_participant *participant);
+
+  // 0 means that a participant is not pinned, so epochs start from 1.
+  std::atomic<std::uint64_t> mEpoch{1};
+
+  // Protects participants and orphans. It is only taken when the epoch advances or a participant
+  // joins or leaves.
+  std::mutex                         mMutex;
+  epoch_participant                 *mHead = nullptr;
+  std::vector<epoch_detail::bucket> mOrphans;
+};
+
+/// Per-thread state of an epoch_domain. It should be used by one thread only.
+class epoch_participant {
+public:
+  /// Number of retired nodes between two attempts to advance the epoch.
+  static constexpr size_t reclaim_threshold = 128;
+
+  explicit epoch_participant(epoch_domain &domain) : mDomain(domain) { domain.join(this); }
+
+  epoch_participant(const epoch_participant &)            = delete;
+  epoch_participant &operator=(const epoch_participant &) = delete;
+
+  /// Nodes that are not safe to free yet are handed over to the domain.
+  ~epoch_participant() { mDomain.leave(this); }
+
+  /// Enter a critical section, in which shared nodes could be accessed. Pins could be nested.
+  void pin() noexcept;
+  void unpin() noexcept;
+
+  bool pinned() const noexcept { return mDepth != 0; }
+
+  epoch_domain &domain() const noexcept { return mDomain; }
+
+  /// Call deleter(node) once no reader could be accessing node. node should have been removed from
+  /// all shared structures already. It could be called whether this participant is pinned or not.
+  template <class T, class Deleter>
+  void retire(T *node, Deleter deleter);
+
+  template <class T>
+  void retire(T *node) {
+    retire(node, std::default_delete<T>());
+  }
+
+  /// Try to advance the epoch and free nodes that are safe now. Return number of freed nodes.
+  size_t reclaim();
+
+  /// Number of retired nodes not freed yet.
+  size_t pending() const noexcept { return mPending; }
+
+private:
+  friend class epoch_domain;
+
+  epoch_domain      &mDomain;
+  epoch_participant *mNext = nullptr;
+
+  // Epoch seen when pinned, or 0 if not pinned.
+  std::atomic<std::uint64_t> mLocal{0};
+  unsigned                   mDepth = 0;
+
+  // Nodes retired in epoch e are kept in mBuckets[e % 3]. A bucket is reused only 3 epochs later,
+  // when all its nodes are safe.
+  epoch_detail::bucket mBuckets[3];
+  size_t               mPending = 0;
+  size_t               mRetired = 0;
+};
+
+/// Pin participant in current scope.
+class epoch_guard {
+public:
+  explicit epoch_guard(epoch_participant &participant) noexcept : mParticipant(participant) {
+    participant.pin();
+  }
+
+  epoch_guard(const epoch_guard &)            = delete;
+  epoch_guard &operator=(const epoch_guard &) = delete;
+
+  ~epoch_guard() { mParticipant.unpin(); }
+
+  epoch_participant &participant() const noexcept { return mParticipant; }
+
+private:
+  epoch_participant &mParticipant;
+};
+
+inline epoch_domain::~epoch_domain() {
+  assert(mHead == nullptr);
+  for (auto &orphan : mOrphans)
+    orphan.reclaim();
+}
+
+inline void epoch_domain::join(epoch_participant *participant) {
+  std::lock_guard<std::mutex> guard(mMutex);
+  participant->mNext = mHead;
+  mHead              = participant;
+}
+
+inline void epoch_domain::leave(epoch_participant *participant) {
+  assert(!participant->pinned());
+  participant->reclaim();
+
+  std::lock_guard<std::mutex> guard(mMutex);
+  for (epoch_participant **p = &mHead; *p != nullptr; p = &(*p)->mNext) {
+    if (*p == participant) {
+      *p = participant->mNext;
+      break;
+    }
+  }
+
+  for (auto &bucket : participant->mBuckets) {
+    if (!bucket.nodes.empty())
+      mOrphans.push_back(std::move(bucket));
+  }
+}
+
+inline bool epoch_domain::try_advance() {
+  std::lock_guard<std::mutex> guard(mMutex);
+
+  std::uint64_t epoch = mEpoch.load();
+  // Pairs with the fence in pin(). A participant that pinned before this fence is seen here, and
+  // one that pins after it sees the current epoch.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (epoch_participant *p = mHead; p != nullptr; p = p->mNext) {
+    std::uint64_t local = p->mLocal.load();
+    if (local != 0 && local != epoch)
+      return false;
+  }
+
+  // Only this thread advances the epoch while holding the mutex.
+  mEpoch.store(epoch + 1);
+
+  auto last = std::remove_if(mOrphans.begin(), mOrphans.end(), [epoch](epoch_detail::bucket &b) {
+    if (b.epoch + 1 > epoch)
+      return false;
+    b.reclaim();
+    return true;
+  });
+  mOrphans.erase(last, mOrphans.end());
+  return true;
+}
+
+inline void epoch_participant::pin() noexcept {
+  if (mDepth++ != 0)
+    return;
+
+  // Make sure that the published epoch is not stale, otherwise it would hold back the domain.
+  std::uint64_t epoch = mDomain.mEpoch.load();
+  for (;;) {
+    mLocal.store(epoch);
+    // Shared nodes must not be loaded before the pin is visible to try_advance().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::uint64_t current = mDomain.mEpoch.load();
+    if (current == epoch)
+      break;
+    epoch = current;
+  }
+}
+
+inline void epoch_participant::unpin() noexcept {
+  assert(mDepth != 0);
+  if (--mDepth == 0)
+    mLocal.store(0, std::memory_order_release);
+}
+
+template <class T, class Deleter>
+void epoch_participant::retire(T *node, Deleter deleter) {
+  using epoch_detail::retired;
+  static_assert(sizeof(Deleter) <= retired::state_size && alignof(Deleter) <= alignof(void *),
+                "Deleter is too large to be stored inline.");
+  static_assert(std::is_trivially_copyable<Deleter>::value &&
+                    std::is_trivially_destructible<Deleter>::value,
+                "Deleter should be trivially copyable.");
+
+  // The epoch must not be read before stores that unlinked node are visible. Otherwise a reader
+  // pinned in a later epoch might still reach node when it is freed.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::uint64_t         epoch  = mDomain.epoch();
+  epoch_detail::bucket &bucket = mBuckets[epoch % 3];
+  if (bucket.epoch != epoch) {
+    // The bucket was filled at least 3 epochs ago.
+    mPending -= bucket.nodes.size();
+    bucket.reclaim();
+    bucket.epoch = epoch;
+  }
+
+  retired entry;
+  entry.node    = const_cast<typename std::remove_cv<T>::type *>(node);
+  entry.reclaim = &epoch_detail::invoke<T, Deleter>;
+  ::new (static_cast<void *>(entry.state)) Deleter(deleter);
+  bucket.nodes.push_back(entry);
+
+  mPending += 1;
+  if (++mRetired % reclaim_threshold == 0)
+    reclaim();
+}
+
+inline size_t epoch_participant::reclaim() {
+  mDomain.try_advance();
+
+  // Nodes retired in epoch e are safe once the epoch is e + 2.
+  std::uint64_t epoch = mDomain.epoch();
+  size_t        freed = 0;
+  for (auto &bucket : mBuckets) {
+    if (!bucket.nodes.empty() && bucket.epoch + 2 <= epoch) {
+      freed += bucket.nodes.size();
+      bucket.reclaim();
+    }
+  }
+  mPending -= freed;
+  return freed;
+}
+
+} // namespace tinystl
+
+#endif // TINYSTL_EPOCH_RECLAMATION_H
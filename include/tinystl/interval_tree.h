@@ -0,0 +1,264 @@
+/// 基于avl_tree的侵入式区间树。
+///
+/// 每个节点保存一个左闭右开区间[start, end)，节点按start排序，并额外维护子树中最大的end。
+/// 查询时，如果一棵子树中最大的end不大于查询区间的起点，那么整棵子树都可以跳过；如果当前节点的
+/// start不小于查询区间的终点，那么右子树也可以跳过。
+///
+/// 与avl_tree一样，实现中没有使用任何堆内存分配，查询也不会分配内存。使用方法如下：
+///
+/// ```cpp
+/// class Lease : public tinystl::interval_node<int64_t> {
+///   Implement Lease here.
+/// };
+///
+/// tinystl::interval_tree<Lease> tree;
+/// tree.insert(&lease);
+/// tree.find_overlapping(lo, hi, [](Lease &lease) { ... });
+/// ```
+///
+/// 注意，节点在树中时不能修改其区间，需要先erase，修改后再重新insert。
+///
+
+#ifndef TINYSTL_INTERVAL_TREE_H
+#define TINYSTL_INTERVAL_TREE_H
+
+#include <tinystl/avl_tree.h>
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+namespace tinystl {
+
+template <class T>
+class interval_tree;
+
+/// Node of interval_tree, which holds a half-open interval [start, end). Compare is default
+/// constructed whenever it is used, so it should be stateless.
+template <class Key, class Compare = std::less<Key>>
+class interval_node : public avl_augmented_node<interval_node<Key, Compare>> {
+public:
+  using key_type    = Key;
+  using key_compare = Compare;
+
+  interval_node() = default;
+
+  interval_node(const Key &start, const Key &end)
+      : mStart(start), mEnd(end), mMaxEnd(&mEnd) {}
+
+  interval_node(const interval_node &other)
+      : avl_augmented_node<interval_node>(other), mStart(other.mStart), mEnd(other.mEnd),
+        mMaxEnd(&mEnd) {}
+
+  interval_node &operator=(const interval_node &other) {
+    avl_augmented_node<interval_node>::operator=(other);
+    mStart  = other.mStart;
+    mEnd    = other.mEnd;
+    mMaxEnd = &mEnd;
+    return *this;
+  }
+
+  const Key &start() const noexcept { return mStart; }
+  const Key &end() const noexcept { return mEnd; }
+
+  /// Max end of intervals in the subtree rooted at this node.
+  const Key &max_end() const noexcept { return *mMaxEnd; }
+
+  /// Reset the interval. The node should not be in any tree.
+  void assign(const Key &start, const Key &end) {
+    mStart  = start;
+    mEnd    = end;
+    mMaxEnd = &mEnd;
+  }
+
+  template <class, class>
+  friend class basic_avl_node;
+
+private:
+  void recompute() noexcept {
+    mMaxEnd = &mEnd;
+    for (auto child : {this->left(), this->right()}) {
+      auto node = static_cast<const interval_node *>(child);
+      if (node != nullptr && Compare()(*mMaxEnd, *node->mMaxEnd))
+        mMaxEnd = node->mMaxEnd;
+    }
+  }
+
+  Key        mStart{};
+  Key        mEnd{};
+  const Key *mMaxEnd = &mEnd;
+};
+
+/// Interval tree for T, which should inherit from interval_node. Intervals are ordered by start,
+/// and intervals with equal or overlapping ranges are allowed.
+template <class T>
+class interval_tree {
+public:
+  using key_type        = typename T::key_type;
+  using key_compare     = typename T::key_compare;
+  using value_type      = T;
+  using reference       = value_type &;
+  using const_reference = const value_type &;
+  using size_type       = size_t;
+  using difference_type = ptrdiff_t;
+  using pointer         = value_type *;
+  using const_pointer   = const value_type *;
+  using interval_type   = interval_node<key_type, key_compare>;
+  using node_type       = avl_augmented_node<interval_type>;
+
+  static_assert(std::is_base_of<interval_type, T>::value, "T should inhert from interval_node.");
+
+  /// Compare intervals by start.
+  struct start_compare {
+    using is_transparent = void;
+
+    bool operator()(const T &lhs, const T &rhs) const noexcept {
+      return key_compare()(lhs.start(), rhs.start());
+    }
+
+    bool operator()(const T &lhs, const key_type &rhs) const noexcept {
+      return key_compare()(lhs.start(), rhs);
+    }
+
+    bool operator()(const key_type &lhs, const T &rhs) const noexcept {
+      return key_compare()(lhs, rhs.start());
+    }
+  };
+
+  using tree_type      = avl_tree<T, start_compare, node_type>;
+  using iterator       = typename tree_type::iterator;
+  using const_iterator = typename tree_type::const_iterator;
+
+  bool      empty() const noexcept { return mTree.empty(); }
+  size_type size() const noexcept { return mTree.size(); }
+
+  iterator       begin() noexcept { return mTree.begin(); }
+  const_iterator begin() const noexcept { return mTree.begin(); }
+
+  iterator       end() noexcept { return mTree.end(); }
+  const_iterator end() const noexcept { return mTree.end(); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+
+  /// Intervals in tree sorted by start.
+  const tree_type &tree() const noexcept { return mTree; }
+
+  void insert(pointer node) noexcept { mTree.insert_multi(node); }
+
+  /// Make sure that node belongs to current tree.
+  void erase(pointer node) noexcept { mTree.erase(node); }
+  void erase(iterator node) noexcept { mTree.erase(node); }
+
+  template <class Func>
+  void clear(Func &&handler) {
+    mTree.clear(handler);
+  }
+
+  /// First interval whose start is not less than key.
+  iterator       lower_bound(const key_type &key) noexcept { return mTree.lower_bound(key); }
+  const_iterator lower_bound(const key_type &key) const noexcept { return mTree.lower_bound(key); }
+
+  /// Return any interval overlapping [lo, hi) in O(log n) time, or nullptr if there is none.
+  pointer find_any(const key_type &lo, const key_type &hi) noexcept {
+    return const_cast<pointer>(find_any_node(lo, hi));
+  }
+
+  const_pointer find_any(const key_type &lo, const key_type &hi) const noexcept {
+    return find_any_node(lo, hi);
+  }
+
+  /// Call callback with each interval overlapping [lo, hi), in order of start. Subtrees whose max
+  /// end is not greater than lo are skipped, so only the search path of hi and subtrees containing
+  /// at least one result are visited, which is O((k + 1) log n) in the worst case.
+  template <class Func>
+  void find_overlapping(const key_type &lo, const key_type &hi, Func &&callback) {
+    auto before_hi = [&](const key_type &start) { return less(start, hi); };
+    visit(mTree.root(), lo, before_hi, callback);
+  }
+
+  template <class Func>
+  void find_overlapping(const key_type &lo, const key_type &hi, Func &&callback) const {
+    auto before_hi = [&](const key_type &start) { return less(start, hi); };
+    visit(mTree.root(), lo, before_hi, callback);
+  }
+
+  /// Call callback with each interval containing point, in order of start.
+  template <class Func>
+  void find_stabbing(const key_type &point, Func &&callback) {
+    auto not_after = [&](const key_type &start) { return !less(point, start); };
+    visit(mTree.root(), point, not_after, callback);
+  }
+
+  template <class Func>
+  void find_stabbing(const key_type &point, Func &&callback) const {
+    auto not_after = [&](const key_type &start) { return !less(point, start); };
+    visit(mTree.root(), point, not_after, callback);
+  }
+
+  /// Count intervals containing point.
+  size_type count_stabbing(const key_type &point) const {
+    size_type count = 0;
+    find_stabbing(point, [&](const_reference) { ++count; });
+    return count;
+  }
+
+private:
+  static bool less(const key_type &lhs, const key_type &rhs) noexcept {
+    return key_compare()(lhs, rhs);
+  }
+
+  static const_pointer as_value(const node_type *node) noexcept {
+    return static_cast<const_pointer>(node);
+  }
+
+  const_pointer find_any_node(const key_type &lo, const key_type &hi) const noexcept;
+
+  /// Visit intervals in subtree of node that end after lo and whose start satisfies in_range,
+  /// which should hold for a prefix of intervals in order of start.
+  template <class Pointer, class Pred, class Func>
+  static void visit(Pointer node, const key_type &lo, Pred &in_range, Func &callback);
+
+  tree_type mTree;
+};
+
+template <class T>
+auto interval_tree<T>::find_any_node(const key_type &lo, const key_type &hi) const noexcept
+    -> const_pointer {
+  const node_type *node = mTree.root();
+  while (node != nullptr) {
+    const_pointer value = as_value(node);
+    if (less(value->start(), hi) && less(lo, value->end()))
+      return value;
+
+    // If some interval in the left subtree ends after lo but does not overlap, it starts at or
+    // after hi, and so does every interval in the right subtree.
+    const node_type *left = node->left();
+    if (left != nullptr && less(lo, as_value(left)->max_end()))
+      node = left;
+    else
+      node = node->right();
+  }
+  return nullptr;
+}
+
+template <class T>
+template <class Pointer, class Pred, class Func>
+void interval_tree<T>::visit(Pointer node, const key_type &lo, Pred &in_range, Func &callback) {
+  while (node != nullptr && less(lo, node->max_end())) {
+    visit(static_cast<Pointer>(node->left()), lo, in_range, callback);
+
+    // Intervals in the right subtree start even later.
+    if (!in_range(node->start()))
+      return;
+
+    if (less(lo, node->end()))
+      callback(*node);
+    node = static_cast<Pointer>(node->right());
+  }
+}
+
+} // namespace tinystl
+
+#endif // TINYSTL_INTERVAL_TREE_H
@@ -0,0 +1,340 @@
+/// 基于顺序锁（seqlock）的并发avl_tree，适用于读多写少的场景。
+///
+/// 写者之间使用互斥锁串行执行，写入前后各将版本号加1，因此写入过程中版本号为奇数。读者不加锁，
+/// 直接沿指针向下查找，结束后检查版本号：如果查找期间版本号发生了变化，说明读到的结构可能不一致，
+/// 需要重新查找。读者之间不会写同一块内存，所以读吞吐量可以随核数线性增长。
+///
+/// 读者可能在写者修改树的同时访问节点，因此：
+/// 1. 节点需要继承optimistic_avl_node，其父子指针都是原子变量，写者以release写入，读者以acquire
+///    读取，读者总能看到新插入节点完整的键；
+/// 2. 查找的步数有上限，结构不一致导致的环路会被检测到并重试；
+/// 3. 被删除的节点由树自带的epoch_domain延迟回收：读者在查找前通过epoch_guard进入临界区，
+///    erase()等函数将节点交给写者线程的epoch_participant，没有读者可能访问它之后才调用删除器；
+/// 4. 比较器不加锁地读取节点的键，因此节点从插入到被回收之间不能修改键，
+///    或者键本身需要以原子操作读写。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// tinystl::optimistic_avl_tree<MyClass> tree;
+///
+/// // 每个线程
+/// tinystl::epoch_participant local(tree.domain());
+///
+/// // 写者
+/// tree.insert_unique(new MyClass(key));
+/// tree.erase(local, node);
+///
+/// // 读者
+/// {
+///   tinystl::epoch_guard guard(local);
+///   const MyClass *p = tree.find(guard, key);
+///   Use p here.
+/// }
+/// ```
+///
+/// 注意，读者得到的指针只在guard存活期间有效。节点默认使用delete释放，也可以向erase()等函数传入
+/// 删除器。所有epoch_participant都需要在树之前析构。
+///
+
+#ifndef TINYSTL_OPTIMISTIC_AVL_TREE_H
+#define TINYSTL_OPTIMISTIC_AVL_TREE_H
+
+#include <tinystl/avl_tree.h>
+#include <tinystl/epoch_reclamation.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace tinystl {
+
+namespace optimistic_avl_detail {
+
+/// Link that may be read by readers while the writer changes it.
+template <class P>
+class atomic_link {
+public:
+  constexpr atomic_link(P ptr = nullptr) noexcept : mPtr(ptr) {}
+
+  atomic_link(const atomic_link &other) noexcept : mPtr(other.get()) {}
+
+  atomic_link &operator=(const atomic_link &other) noexcept { return (*this) = other.get(); }
+
+  atomic_link &operator=(P ptr) noexcept {
+    mPtr.store(ptr, std::memory_order_release);
+    return *this;
+  }
+
+  P get() const noexcept { return mPtr.load(std::memory_order_acquire); }
+
+  operator P() const noexcept { return get(); }
+  P operator->() const noexcept { return get(); }
+
+private:
+  std::atomic<P> mPtr;
+};
+
+struct atomic_links {
+  template <class P>
+  using type = atomic_link<P>;
+};
+
+} // namespace optimistic_avl_detail
+
+/// Node of optimistic_avl_tree.
+using optimistic_avl_node =
+    basic_avl_node<avl_tree_detail::no_augment, optimistic_avl_detail::atomic_links>;
+
+/// avl_tree that allows one writer at a time and any number of lock-free readers.
+template <class T, class Compare = std::less<T>, class Node = optimistic_avl_node>
+class optimistic_avl_tree {
+  static_assert(std::is_same<typename Node::link_type,
+                             optimistic_avl_detail::atomic_link<typename Node::pointer>>::value,
+                "Readers need the atomic links of optimistic_avl_node.");
+
+public:
+  using tree_type       = avl_tree<T, Compare, Node>;
+  using key_type        = T;
+  using value_type      = T;
+  using reference       = value_type &;
+  using const_reference = const value_type &;
+  using size_type       = size_t;
+  using key_compare     = Compare;
+  using pointer         = value_type *;
+  using const_pointer   = const value_type *;
+
+  optimistic_avl_tree() = default;
+
+  explicit optimistic_avl_tree(const Compare &cmp) : mTree(cmp) {}
+
+  optimistic_avl_tree(const optimistic_avl_tree &)            = delete;
+  optimistic_avl_tree &operator=(const optimistic_avl_tree &) = delete;
+
+  /// Domain that readers pin and removed nodes are retired to.
+  epoch_domain &domain() noexcept { return mDomain; }
+
+  /// Number of nodes when the last write finished.
+  size_type size() const noexcept { return mSize.load(std::memory_order_relaxed); }
+  bool      empty() const noexcept { return size() == 0; }
+
+  // Writers below are serialized by a mutex.
+
+  bool insert_unique(pointer node) {
+    return write([node](tree_type &tree) { return tree.insert_unique(node); });
+  }
+
+  void insert_multi(pointer node) {
+    write([node](tree_type &tree) { tree.insert_multi(node); });
+  }
+
+  /// Replace the node equal to node and retire the replaced one to local. Return false if node is
+  /// inserted as a new node.
+  template <class Deleter = std::default_delete<T>>
+  bool insert_or_replace(epoch_participant &local, pointer node, Deleter deleter = Deleter()) {
+    assert(&local.domain() == &mDomain);
+    pointer old = write([node](tree_type &tree) { return tree.insert_or_replace(node); });
+    if (old != nullptr)
+      local.retire(old, deleter);
+    return old != nullptr;
+  }
+
+  /// Make sure that node belongs to current tree. It is retired to local and deleted once no
+  /// reader can be visiting it, so it must not be inserted again.
+  template <class Deleter = std::default_delete<T>>
+  void erase(epoch_participant &local, pointer node, Deleter deleter = Deleter()) {
+    assert(&local.domain() == &mDomain);
+    write([node](tree_type &tree) { tree.erase(node); });
+    local.retire(node, deleter);
+  }
+
+  /// Remove and retire all nodes to local.
+  template <class Deleter = std::default_delete<T>>
+  void clear(epoch_participant &local, Deleter deleter = Deleter()) {
+    assert(&local.domain() == &mDomain);
+    write([&](tree_type &tree) { tree.clear([&](pointer node) { local.retire(node, deleter); }); });
+  }
+
+  /// Run fn with the underlying tree as a writer and return its result. Readers retry until fn
+  /// returns. Nodes removed by fn should be retired to a participant of domain() after it returns.
+  template <class Func>
+  auto write(Func &&fn) -> decltype(fn(std::declval<tree_type &>()));
+
+  // Readers below do not block each other and never wait for the writer lock. They retry if a
+  // writer modified the tree during the search. guard must pin a participant of domain(), and
+  // returned nodes stay alive until it is destroyed.
+
+  const_pointer find(const epoch_guard &guard, const_reference value) const noexcept {
+    return find_impl(guard, value);
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_pointer find(const epoch_guard &guard, const Key &key) const noexcept {
+    return find_impl(guard, key);
+  }
+
+  bool contains(const epoch_guard &guard, const_reference value) const noexcept {
+    return find_impl(guard, value) != nullptr;
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  bool contains(const epoch_guard &guard, const Key &key) const noexcept {
+    return find_impl(guard, key) != nullptr;
+  }
+
+  /// Return the first node not less than value, or nullptr if there is none.
+  const_pointer lower_bound(const epoch_guard &guard, const_reference value) const noexcept {
+    return lower_bound_impl(guard, value);
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_pointer lower_bound(const epoch_guard &guard, const Key &key) const noexcept {
+    return lower_bound_impl(guard, key);
+  }
+
+  /// Underlying tree. It is safe to use only if no writer is running.
+  const tree_type &unsafe_tree() const noexcept { return mTree; }
+
+  /// Height of an AVL tree with n nodes is less than 1.45 log2(n + 2). A search taking more steps
+  /// must have followed links changed by a writer.
+  static constexpr size_type max_steps = sizeof(size_type) * 8 * 3 / 2 + 2;
+
+private:
+  using const_node_pointer = const Node *;
+
+  /// Run search and validate it against version. search returns false if it gave up.
+  template <class Search>
+  const_pointer read(const epoch_guard &guard, Search &&search) const noexcept;
+
+  template <class Key>
+  const_pointer find_impl(const epoch_guard &guard, const Key &key) const noexcept;
+  template <class Key>
+  const_pointer lower_bound_impl(const epoch_guard &guard, const Key &key) const noexcept;
+
+  template <class L, class R>
+  int compare(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::compare(mTree.key_comp(), lhs, rhs,
+                                    std::integral_constant<bool, tree_type::is_three_way>());
+  }
+
+  template <class L, class R>
+  bool less(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::less(mTree.key_comp(), lhs, rhs,
+                                 std::integral_constant<bool, tree_type::is_three_way>());
+  }
+
+  epoch_domain               mDomain;
+  tree_type                  mTree;
+  std::mutex                 mWriter;
+  std::atomic<std::size_t>   mSize{0};
+  // Odd while a writer is modifying mTree.
+  std::atomic<std::uint64_t> mVersion{0};
+};
+
+template <class T, class Compare, class Node>
+constexpr typename optimistic_avl_tree<T, Compare, Node>::size_type
+    optimistic_avl_tree<T, Compare, Node>::max_steps;
+
+template <class T, class Compare, class Node>
+template <class Func>
+auto optimistic_avl_tree<T, Compare, Node>::write(Func &&fn)
+    -> decltype(fn(std::declval<tree_type &>())) {
+  std::lock_guard<std::mutex> guard(mWriter);
+
+  struct section {
+    optimistic_avl_tree *tree;
+    std::uint64_t        version;
+
+    ~section() {
+      tree->mSize.store(tree->mTree.recount(), std::memory_order_relaxed);
+      tree->mVersion.store(version + 2, std::memory_order_release);
+    }
+  };
+
+  std::uint64_t version = mVersion.load(std::memory_order_relaxed);
+  mVersion.store(version + 1, std::memory_order_relaxed);
+  // Readers that see any of the following writes also see the odd version.
+  std::atomic_thread_fence(std::memory_order_release);
+
+  section guard_version{this, version};
+  return fn(mTree);
+}
+
+template <class T, class Compare, class Node>
+template <class Search>
+auto optimistic_avl_tree<T, Compare, Node>::read(const epoch_guard &guard,
+                                                 Search           &&search) const noexcept
+    -> const_pointer {
+  assert(&guard.participant().domain() == &mDomain && guard.participant().pinned());
+  (void)guard;
+
+  for (;;) {
+    std::uint64_t version = mVersion.load(std::memory_order_acquire);
+    if (version & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    const_node_pointer result   = nullptr;
+    bool               finished = search(result);
+
+    // Reads of the search happen before reading version again.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (finished && mVersion.load(std::memory_order_relaxed) == version)
+      return static_cast<const_pointer>(result);
+  }
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto optimistic_avl_tree<T, Compare, Node>::find_impl(const epoch_guard &guard,
+                                                      const Key         &key) const noexcept
+    -> const_pointer {
+  return read(guard, [&](const_node_pointer &result) {
+    const_node_pointer node = mTree.root();
+    for (size_type steps = 0; node != nullptr; ++steps) {
+      if (steps == max_steps)
+        return false;
+
+      int cmp = compare(key, *static_cast<const_pointer>(node));
+      if (cmp == 0)
+        break;
+      node = (cmp < 0) ? node->left() : node->right();
+    }
+    result = node;
+    return true;
+  });
+}
+
+template <class T, class Compare, class Node>
+template <class Key>
+auto optimistic_avl_tree<T, Compare, Node>::lower_bound_impl(const epoch_guard &guard,
+                                                             const Key         &key) const noexcept
+    -> const_pointer {
+  return read(guard, [&](const_node_pointer &result) {
+    const_node_pointer node = mTree.root();
+    for (size_type steps = 0; node != nullptr; ++steps) {
+      if (steps == max_steps)
+        return false;
+
+      if (less(*static_cast<const_pointer>(node), key)) {
+        node = node->right();
+      } else {
+        result = node;
+        node   = node->left();
+      }
+    }
+    return true;
+  });
+}
+
+} // namespace tinystl
+
+#endif // TINYSTL_OPTIMISTIC_AVL_TREE_H
@@ -0,0 +1,588 @@
+/// 基于路径复制的持久化AVL Tree。
+///
+/// 节点创建后不再修改。插入与删除时只复制从根节点到目标位置路径上的O(log n)个节点，新的根节点与
+/// 旧版本共享所有未修改的子树，因此snapshot()只需要复制根节点指针，时间复杂度为O(1)。节点带有原子
+/// 引用计数，最后一个引用它的版本被销毁时才释放。
+///
+/// 与avl_tree不同，这里的节点由树通过Allocator分配，值在插入时被复制或移动到节点中。
+///
+/// 适用于需要在写入的同时进行长时间一致性扫描的场景：一个写线程持续更新树，其他线程通过snapshot()
+/// 获得某一时刻的快照，在快照上的查找与遍历不需要加锁，也不会阻塞写线程。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// tinystl::persistent_avl_tree<int64_t> tree;
+///
+/// // writer
+/// tree.insert_unique(key);
+///
+/// // readers
+/// auto snapshot = tree.snapshot();
+/// for (int64_t key : snapshot) { ... }
+/// ```
+///
+/// 注意：
+/// 1. 只有snapshot()与拷贝构造可以在其他线程更新树时调用，其他操作（包括赋值与移动）与标准容器
+///    一样需要外部同步；被移动的树变为空树；
+/// 2. 节点可能由任意一个快照释放，因此Allocator的所有副本需要相等；
+/// 3. 迭代器中保存了完整的路径栈（64位平台上约800字节），应当避免频繁拷贝迭代器。
+///
+
+#ifndef TINYSTL_PERSISTENT_AVL_TREE_H
+#define TINYSTL_PERSISTENT_AVL_TREE_H
+
+#include <tinystl/avl_parentless_tree.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace tinystl {
+
+template <class T, class Compare, class Allocator>
+class persistent_avl_tree;
+
+namespace persistent_avl_detail {
+
+/// Immutable node shared by all versions that reach it.
+template <class T>
+struct node {
+  template <class... Args>
+  node(node *left, node *right, Args &&...args)
+      : mValue(std::forward<Args>(args)...), mLeft(left), mRight(right),
+        mHeight(static_cast<std::uint8_t>(std::max(height_of(left), height_of(right)) + 1)) {}
+
+  node *left() const noexcept { return mLeft; }
+  node *right() const noexcept { return mRight; }
+
+  static size_t height_of(const node *n) noexcept { return (n == nullptr) ? 0 : n->mHeight; }
+
+  T                   mValue;
+  node               *mLeft;
+  node               *mRight;
+  // Number of parents and versions referring to this node.
+  std::atomic<size_t> mRefs{1};
+  std::uint8_t        mHeight;
+};
+
+} // namespace persistent_avl_detail
+
+/// Iterator of a persistent_avl_tree. It stays valid as long as the version it was obtained from,
+/// even if the tree is updated later.
+template <class T>
+class persistent_avl_tree_const_iterator {
+public:
+  using value_type        = const T;
+  using reference         = const value_type &;
+  using const_reference   = const value_type &;
+  using pointer           = const T *;
+  using const_pointer     = const T *;
+  using difference_type   = std::ptrdiff_t;
+  using iterator_category = std::bidirectional_iterator_tag;
+
+  persistent_avl_tree_const_iterator() noexcept = default;
+
+  persistent_avl_tree_const_iterator &operator++() noexcept {
+    mPath.increment();
+    return (*this);
+  }
+
+  persistent_avl_tree_const_iterator operator++(int) noexcept {
+    persistent_avl_tree_const_iterator ret = (*this);
+    ++(*this);
+    return ret;
+  }
+
+  persistent_avl_tree_const_iterator &operator--() noexcept {
+    mPath.decrement(mRoot);
+    return (*this);
+  }
+
+  persistent_avl_tree_const_iterator operator--(int) noexcept {
+    persistent_avl_tree_const_iterator ret = (*this);
+    --(*this);
+    return ret;
+  }
+
+  reference operator*() const noexcept { return *get(); }
+  pointer   operator->() const noexcept { return get(); }
+
+  bool operator==(const persistent_avl_tree_const_iterator &rhs) const noexcept {
+    return (mRoot == rhs.mRoot && mPath.top() == rhs.mPath.top());
+  }
+
+  bool operator!=(const persistent_avl_tree_const_iterator &rhs) const noexcept {
+    return !((*this) == rhs);
+  }
+
+  const_pointer get() const noexcept {
+    return (mPath.top() == nullptr) ? nullptr : &mPath.top()->mValue;
+  }
+
+  template <class, class, class>
+  friend class persistent_avl_tree;
+
+private:
+  using node_type = persistent_avl_detail::node<T>;
+
+  explicit persistent_avl_tree_const_iterator(const node_type *root) noexcept : mRoot(root) {}
+
+  const node_type                                             *mRoot = nullptr;
+  avl_parentless_tree_detail::path_stack<const node_type *> mPath;
+};
+
+/// Ordered set of T whose versions share unchanged subtrees.
+template <class T, class Compare = std::less<T>, class Allocator = std::allocator<T>>
+class persistent_avl_tree {
+public:
+  using key_type        = T;
+  using value_type      = T;
+  using reference       = const value_type &;
+  using const_reference = const value_type &;
+  using size_type       = size_t;
+  using difference_type = ptrdiff_t;
+  using key_compare     = Compare;
+  using allocator_type  = Allocator;
+  using pointer         = const value_type *;
+  using const_pointer   = const value_type *;
+  using iterator        = persistent_avl_tree_const_iterator<T>;
+  using const_iterator  = persistent_avl_tree_const_iterator<T>;
+
+  persistent_avl_tree() : persistent_avl_tree(Compare()) {}
+
+  explicit persistent_avl_tree(const Compare &cmp, const Allocator &alloc = Allocator())
+      : mCompare(cmp), mAllocator(alloc) {}
+
+  /// Share all nodes of other in O(1) time. It is safe even if another thread is updating other.
+  persistent_avl_tree(const persistent_avl_tree &other)
+      : persistent_avl_tree(other, std::unique_lock<std::mutex>(other.mMutex)) {}
+
+  /// Take over all nodes of other in O(1) time. other becomes empty.
+  persistent_avl_tree(persistent_avl_tree &&other)
+      : persistent_avl_tree(std::move(other), std::unique_lock<std::mutex>(other.mMutex)) {}
+
+  persistent_avl_tree &operator=(const persistent_avl_tree &other) {
+    if (this != &other) {
+      persistent_avl_tree copy(other);
+      swap_locked(copy);
+    }
+    return (*this);
+  }
+
+  persistent_avl_tree &operator=(persistent_avl_tree &&other) {
+    if (this != &other) {
+      persistent_avl_tree copy(std::move(other));
+      swap_locked(copy);
+    }
+    return (*this);
+  }
+
+  ~persistent_avl_tree() { release(mRoot); }
+
+  /// Current version of this tree in O(1) time. It could be called while another thread is
+  /// updating this tree, and the snapshot is not affected by later updates.
+  persistent_avl_tree snapshot() const { return persistent_avl_tree(*this); }
+
+  bool      empty() const noexcept { return mRoot == nullptr; }
+  size_type size() const noexcept { return mSize; }
+
+  const_iterator begin() const noexcept {
+    const_iterator it(mRoot);
+    it.mPath.push_leftmost(mRoot);
+    return it;
+  }
+
+  const_iterator end() const noexcept { return const_iterator(mRoot); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+
+  /// The tree should not be empty.
+  const_reference front() const noexcept { return *begin(); }
+  const_reference back() const noexcept { return *std::prev(end()); }
+
+  /// Insert value if there is no equal value. O(log n) nodes are copied.
+  bool insert_unique(const value_type &value) { return insert_impl(value); }
+  bool insert_unique(value_type &&value) { return insert_impl(std::move(value)); }
+
+  /// Remove the value equal to value. Return false if there is none.
+  bool erase(const_reference value) { return erase_impl(value); }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  bool erase(const Key &key) {
+    return erase_impl(key);
+  }
+
+  void clear() { replace_root(nullptr, 0); }
+
+  const_pointer find(const_reference value) const noexcept { return find_impl(value); }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_pointer find(const Key &key) const noexcept {
+    return find_impl(key);
+  }
+
+  bool contains(const_reference value) const noexcept { return find_impl(value) != nullptr; }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  bool contains(const Key &key) const noexcept {
+    return find_impl(key) != nullptr;
+  }
+
+  const_iterator lower_bound(const_reference value) const noexcept {
+    return bound_impl(value, std::false_type());
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_iterator lower_bound(const Key &key) const noexcept {
+    return bound_impl(key, std::false_type());
+  }
+
+  const_iterator upper_bound(const_reference value) const noexcept {
+    return bound_impl(value, std::true_type());
+  }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  const_iterator upper_bound(const Key &key) const noexcept {
+    return bound_impl(key, std::true_type());
+  }
+
+  key_compare    key_comp() const { return mCompare; }
+  allocator_type get_allocator() const { return allocator_type(mAllocator); }
+
+  static constexpr bool is_three_way =
+      avl_tree_detail::is_three_way_compare<Compare, value_type, value_type>::value;
+
+private:
+  using node_type      = persistent_avl_detail::node<T>;
+  using node_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<node_type>;
+  using node_traits    = std::allocator_traits<node_allocator>;
+
+  struct releaser {
+    persistent_avl_tree *tree;
+
+    void operator()(node_type *node) const noexcept { tree->release(node); }
+  };
+
+  /// One reference to a node, released if it is not handed over to a new node.
+  using owned = std::unique_ptr<node_type, releaser>;
+
+  // other is locked while its members are copied.
+  persistent_avl_tree(const persistent_avl_tree &other, std::unique_lock<std::mutex>)
+      : mCompare(other.mCompare), mAllocator(other.mAllocator),
+        mRoot(acquire(other.mRoot).release()), mSize(other.mSize) {}
+
+  persistent_avl_tree(persistent_avl_tree &&other, std::unique_lock<std::mutex>)
+      : mCompare(other.mCompare), mAllocator(other.mAllocator), mRoot(other.mRoot),
+        mSize(other.mSize) {
+    other.mRoot = nullptr;
+    other.mSize = 0;
+  }
+
+  /// Exchange all members with a tree that is not shared with other threads. The old version is
+  /// released by other.
+  void swap_locked(persistent_avl_tree &other) {
+    using std::swap;
+    std::lock_guard<std::mutex> guard(mMutex);
+    swap(mCompare, other.mCompare);
+    swap(mAllocator, other.mAllocator);
+    swap(mRoot, other.mRoot);
+    swap(mSize, other.mSize);
+  }
+
+  /// Return a negative integer if lhs < rhs, a positive integer if rhs < lhs, 0 otherwise.
+  template <class L, class R>
+  int compare(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::compare(mCompare, lhs, rhs,
+                                    std::integral_constant<bool, is_three_way>());
+  }
+
+  template <class L, class R>
+  bool less(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::less(mCompare, lhs, rhs, std::integral_constant<bool, is_three_way>());
+  }
+
+  static size_type height(const node_type *node) noexcept { return node_type::height_of(node); }
+
+  owned acquire(node_type *node) noexcept {
+    if (node != nullptr)
+      node->mRefs.fetch_add(1, std::memory_order_relaxed);
+    return owned(node, releaser{this});
+  }
+
+  void release(node_type *node) noexcept;
+
+  /// Create a node that takes over references of left and right.
+  template <class... Args>
+  owned make(owned left, owned right, Args &&...args);
+
+  /// Create a node with value, left and right, rotating if their heights differ by 2.
+  owned balance(owned left, owned right, const value_type &value);
+
+  template <class V>
+  owned insert_node(node_type *node, V &&value, bool &inserted);
+
+  template <class Key>
+  owned erase_node(node_type *node, const Key &key, bool &erased);
+
+  /// Remove the first node of a non-empty subtree. The removed node is still alive since the old
+  /// version holds it.
+  owned erase_first(node_type *node, const node_type *&first);
+
+  template <class V>
+  bool insert_impl(V &&value);
+
+  template <class Key>
+  bool erase_impl(const Key &key);
+
+  template <class Key>
+  const_pointer find_impl(const Key &key) const noexcept;
+
+  template <class Key, bool Upper>
+  const_iterator bound_impl(const Key &key, std::integral_constant<bool, Upper>) const noexcept;
+
+  /// Publish a new version. Snapshots taken concurrently see either the old or the new one.
+  void replace_root(node_type *root, size_type size) noexcept;
+
+  Compare            mCompare;
+  node_allocator     mAllocator;
+  node_type         *mRoot = nullptr;
+  size_type          mSize = 0;
+  // Guards mRoot and mSize against snapshot() from other threads.
+  mutable std::mutex mMutex;
+};
+
+template <class T, class Compare, class Allocator>
+constexpr bool persistent_avl_tree<T, Compare, Allocator>::is_three_way;
+
+template <class T, class Compare, class Allocator>
+void persistent_avl_tree<T, Compare, Allocator>::release(node_type *node) noexcept {
+  while (node != nullptr && node->mRefs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    release(node->left());
+    node_type *right = node->right();
+    node_traits::destroy(mAllocator, node);
+    node_traits::deallocate(mAllocator, node, 1);
+    node = right;
+  }
+}
+
+template <class T, class Compare, class Allocator>
+template <class... Args>
+auto persistent_avl_tree<T, Compare, Allocator>::make(owned left, owned right, Args &&...args)
+    -> owned {
+  node_type *node = node_traits::allocate(mAllocator, 1);
+  try {
+    node_traits::construct(mAllocator, node, left.get(), right.get(), std::forward<Args>(args)...);
+  } catch (...) {
+    node_traits::deallocate(mAllocator, node, 1);
+    throw;
+  }
+  left.release();
+  right.release();
+  return owned(node, releaser{this});
+}
+
+template <class T, class Compare, class Allocator>
+auto persistent_avl_tree<T, Compare, Allocator>::balance(owned             left,
+                                                         owned             right,
+                                                         const value_type &value) -> owned {
+  size_type hl = height(left.get());
+  size_type hr = height(right.get());
+
+  if (hl > hr + 1) {
+    node_type *l  = left.get();
+    node_type *ll = l->left();
+    node_type *lr = l->right();
+    if (height(ll) >= height(lr)) {
+      owned new_right = make(acquire(lr), std::move(right), value);
+      return make(acquire(ll), std::move(new_right), l->mValue);
+    }
+
+    owned new_left  = make(acquire(ll), acquire(lr->left()), l->mValue);
+    owned new_right = make(acquire(lr->right()), std::move(right), value);
+    return make(std::move(new_left), std::move(new_right), lr->mValue);
+  }
+
+  if (hr > hl + 1) {
+    node_type *r  = right.get();
+    node_type *rl = r->left();
+    node_type *rr = r->right();
+    if (height(rr) >= height(rl)) {
+      owned new_left = make(std::move(left), acquire(rl), value);
+      return make(std::move(new_left), acquire(rr), r->mValue);
+    }
+
+    owned new_left  = make(std::move(left), acquire(rl->left()), value);
+    owned new_right = make(acquire(rl->right()), acquire(rr), r->mValue);
+    return make(std::move(new_left), std::move(new_right), rl->mValue);
+  }
+
+  return make(std::move(left), std::move(right), value);
+}
+
+template <class T, class Compare, class Allocator>
+template <class V>
+auto persistent_avl_tree<T, Compare, Allocator>::insert_node(node_type *node,
+                                                             V         &&value,
+                                                             bool       &inserted) -> owned {
+  if (node == nullptr) {
+    inserted = true;
+    return make(owned(nullptr, releaser{this}), owned(nullptr, releaser{this}),
+                std::forward<V>(value));
+  }
+
+  int cmp = compare(value, node->mValue);
+  if (cmp < 0) {
+    owned left = insert_node(node->left(), std::forward<V>(value), inserted);
+    if (!inserted)
+      return owned(nullptr, releaser{this});
+    return balance(std::move(left), acquire(node->right()), node->mValue);
+  }
+
+  if (cmp > 0) {
+    owned right = insert_node(node->right(), std::forward<V>(value), inserted);
+    if (!inserted)
+      return owned(nullptr, releaser{this});
+    return balance(acquire(node->left()), std::move(right), node->mValue);
+  }
+
+  inserted = false;
+  return owned(nullptr, releaser{this});
+}
+
+template <class T, class Compare, class Allocator>
+template <class Key>
+auto persistent_avl_tree<T, Compare, Allocator>::erase_node(node_type *node,
+                                                            const Key &key,
+                                                            bool      &erased) -> owned {
+  if (node == nullptr) {
+    erased = false;
+    return owned(nullptr, releaser{this});
+  }
+
+  int cmp = compare(key, node->mValue);
+  if (cmp < 0) {
+    owned left = erase_node(node->left(), key, erased);
+    if (!erased)
+      return owned(nullptr, releaser{this});
+    return balance(std::move(left), acquire(node->right()), node->mValue);
+  }
+
+  if (cmp > 0) {
+    owned right = erase_node(node->right(), key, erased);
+    if (!erased)
+      return owned(nullptr, releaser{this});
+    return balance(acquire(node->left()), std::move(right), node->mValue);
+  }
+
+  erased = true;
+  if (node->left() == nullptr)
+    return acquire(node->right());
+  if (node->right() == nullptr)
+    return acquire(node->left());
+
+  // Replace node by its successor.
+  const node_type *first = nullptr;
+  owned            right = erase_first(node->right(), first);
+  return balance(acquire(node->left()), std::move(right), first->mValue);
+}
+
+template <class T, class Compare, class Allocator>
+auto persistent_avl_tree<T, Compare, Allocator>::erase_first(node_type       *node,
+                                                             const node_type *&first) -> owned {
+  if (node->left() == nullptr) {
+    first = node;
+    return acquire(node->right());
+  }
+
+  owned left = erase_first(node->left(), first);
+  return balance(std::move(left), acquire(node->right()), node->mValue);
+}
+
+template <class T, class Compare, class Allocator>
+template <class V>
+bool persistent_avl_tree<T, Compare, Allocator>::insert_impl(V &&value) {
+  bool  inserted = false;
+  owned root     = insert_node(mRoot, std::forward<V>(value), inserted);
+  if (!inserted)
+    return false;
+
+  replace_root(root.release(), mSize + 1);
+  return true;
+}
+
+template <class T, class Compare, class Allocator>
+template <class Key>
+bool persistent_avl_tree<T, Compare, Allocator>::erase_impl(const Key &key) {
+  bool  erased = false;
+  owned root   = erase_node(mRoot, key, erased);
+  if (!erased)
+    return false;
+
+  replace_root(root.release(), mSize - 1);
+  return true;
+}
+
+template <class T, class Compare, class Allocator>
+void persistent_avl_tree<T, Compare, Allocator>::replace_root(node_type *root,
+                                                              size_type  size) noexcept {
+  node_type *old;
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    old   = mRoot;
+    mRoot = root;
+    mSize = size;
+  }
+  release(old);
+}
+
+template <class T, class Compare, class Allocator>
+template <class Key>
+auto persistent_avl_tree<T, Compare, Allocator>::find_impl(const Key &key) const noexcept
+    -> const_pointer {
+  const node_type *node = mRoot;
+  while (node != nullptr) {
+    int cmp = compare(key, node->mValue);
+    if (cmp < 0)
+      node = node->left();
+    else if (cmp > 0)
+      node = node->right();
+    else
+      return &node->mValue;
+  }
+  return nullptr;
+}
+
+template <class T, class Compare, class Allocator>
+template <class Key, bool Upper>
+auto persistent_avl_tree<T, Compare, Allocator>::bound_impl(
+    const Key &key, std::integral_constant<bool, Upper>) const noexcept -> const_iterator {
+  // Keep the whole path, so that the iterator could move on from the result.
+  const_iterator it(mRoot);
+  size_type      depth = 0;
+  for (const node_type *node = mRoot; node != nullptr;) {
+    it.mPath.push(node);
+    bool go_right = Upper ? !less(key, node->mValue) : less(node->mValue, key);
+    if (go_right) {
+      node = node->right();
+    } else {
+      depth = it.mPath.depth();
+      node  = node->left();
+    }
+  }
+  it.mPath.resize(depth);
+  return it;
+}
+
+} // namespace tinystl
+
+#endif // TINYSTL_PERSISTENT_AVL_TREE_H
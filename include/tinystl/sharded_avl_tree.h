@@ -0,0 +1,544 @@
+/// 按键的范围分片的并发avl_tree。
+///
+/// 键空间被若干个边界划分为N个连续的分片，每个分片是一棵带有独立互斥锁的avl_tree。插入、删除、
+/// 查找只需要锁住键所在的分片，因此键分布均匀时，写吞吐量可以随分片数与线程数近似线性增长。
+///
+/// 1. 有序遍历与lower_bound按照分片顺序进行，先锁住下一个分片再释放当前分片，
+///    因此遍历期间即使边界发生调整，也不会重复或遗漏节点。
+/// 2. rebalance()可以在线调整分片边界：相邻两个分片同时加锁后，通过split与join在O(log n)时间内
+///    把一段子树移动到另一个分片（普通avl_node需要额外的O(k)时间找到分裂的位置，avl_rank_node
+///    只需要O(log n)）。
+/// 3. 分片边界只保存由KeyOf从节点中提取的键，而不是整个节点的副本。查找分片时不加锁地二分查找
+///    边界，rebalance()修改边界前后各将版本号加1（顺序锁），版本号在查找期间变化时重新查找；
+///    锁住分片后再检查键是否属于该分片，因为边界只在相邻两个分片都被锁住时才会修改。
+///    边界按机器字逐个原子地读写，读到一半的边界只会被丢弃，因此键的类型需要可以平凡复制，
+///    例如整数或定长数组。
+///    KeyOf不是默认的identity时，Compare需要能够比较键与T，以及键与键。
+///
+/// 使用方法如下：
+///
+/// ```cpp
+/// struct key_of {
+///   int64_t operator()(const MyClass &node) const noexcept { return node.id; }
+/// };
+///
+/// std::vector<int64_t> bounds = ...; // 有序的N - 1个边界
+/// tinystl::sharded_avl_tree<MyClass, MyCompare, tinystl::avl_node, key_of> tree(bounds.begin(),
+///                                                                                bounds.end());
+///
+/// tree.insert_unique(&node);
+/// MyClass *p = tree.find(key);
+/// tree.rebalance();
+/// ```
+///
+/// 注意，返回的指针只保证在调用结束的时刻有效，之后访问节点时需要由使用者保证节点仍然在树中。
+///
+
+#ifndef TINYSTL_SHARDED_AVL_TREE_H
+#define TINYSTL_SHARDED_AVL_TREE_H
+
+#include <tinystl/avl_tree.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tinystl {
+
+namespace sharded_avl_detail {
+
+/// Use the whole node as boundary key.
+struct identity {
+  template <class T>
+  const T &operator()(const T &value) const noexcept {
+    return value;
+  }
+};
+
+/// Trivially copyable value stored as atomic words, so that it could be read while being written.
+/// A read racing with a write might return a mix of both, which should be detected by a version.
+template <class T>
+class atomic_bound {
+public:
+  T load() const noexcept {
+    std::uintptr_t buffer[words];
+    for (size_t i = 0; i < words; ++i)
+      buffer[i] = mWords[i].load(std::memory_order_relaxed);
+
+    T value;
+    std::memcpy(&value, buffer, sizeof(T));
+    return value;
+  }
+
+  void store(const T &value) noexcept {
+    std::uintptr_t buffer[words] = {};
+    std::memcpy(buffer, &value, sizeof(T));
+    for (size_t i = 0; i < words; ++i)
+      mWords[i].store(buffer[i], std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr size_t words = (sizeof(T) + sizeof(std::uintptr_t) - 1) / sizeof(std::uintptr_t);
+
+  std::atomic<std::uintptr_t> mWords[words];
+};
+
+} // namespace sharded_avl_detail
+
+/// Ordered set of T split into range shards. Each shard is an avl_tree protected by its own lock.
+/// Boundaries are keys extracted from nodes by KeyOf.
+template <class T,
+          class Compare = std::less<T>,
+          class Node    = avl_node,
+          class KeyOf   = sharded_avl_detail::identity>
+class sharded_avl_tree {
+public:
+  using tree_type       = avl_tree<T, Compare, Node>;
+  using key_type        = T;
+  using value_type      = T;
+  using reference       = value_type &;
+  using const_reference = const value_type &;
+  using size_type       = size_t;
+  using key_compare     = Compare;
+  using pointer         = value_type *;
+  using const_pointer   = const value_type *;
+  using bound_type =
+      typename std::decay<decltype(std::declval<KeyOf &>()(std::declval<const T &>()))>::type;
+
+  static_assert(std::is_trivially_copyable<bound_type>::value &&
+                    std::is_default_constructible<bound_type>::value,
+                "Boundaries are read without locks, so they should be trivially copyable.");
+
+  /// [first, last) are the sorted boundaries, and there are one more shards than boundaries. Shard
+  /// i holds nodes not less than boundary i - 1 and less than boundary i. Boundaries are copied.
+  template <class InputIt>
+  sharded_avl_tree(InputIt        first,
+                   InputIt        last,
+                   const Compare &cmp    = Compare(),
+                   const KeyOf   &key_of = KeyOf());
+
+  sharded_avl_tree(const sharded_avl_tree &)            = delete;
+  sharded_avl_tree &operator=(const sharded_avl_tree &) = delete;
+
+  /// Number of nodes. It is exact only if no update is running.
+  size_type size() const noexcept;
+  bool      empty() const noexcept { return size() == 0; }
+
+  size_type shard_count() const noexcept { return mBounds.size() + 1; }
+
+  size_type shard_size(size_type shard) const noexcept {
+    assert(shard < shard_count());
+    return mShards[shard].count.load(std::memory_order_relaxed);
+  }
+
+  bool insert_unique(pointer node);
+  void insert_multi(pointer node);
+
+  /// Make sure that node belongs to current tree.
+  void erase(pointer node);
+
+  template <class Func>
+  void clear(Func &&handler);
+
+  pointer find(const_reference value) { return find_impl(value); }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  pointer find(const Key &key) {
+    return find_impl(key);
+  }
+
+  bool contains(const_reference value) { return find_impl(value) != nullptr; }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  bool contains(const Key &key) {
+    return find_impl(key) != nullptr;
+  }
+
+  /// Return the first node not less than value, or nullptr if there is none. Following shards are
+  /// searched if the shard of value has no such node.
+  pointer lower_bound(const_reference value) { return lower_bound_impl(value); }
+
+  template <class Key, class C = Compare, class = typename C::is_transparent>
+  pointer lower_bound(const Key &key) {
+    return lower_bound_impl(key);
+  }
+
+  /// Call fn on all nodes in order. Shards are locked one after another, so fn should not call
+  /// other functions of this tree.
+  template <class Func>
+  void for_each(Func &&fn);
+
+  /// Call fn on nodes in [lo, hi) in order.
+  template <class Key, class Func>
+  void for_each_range(const Key &lo, const Key &hi, Func &&fn);
+
+  /// Move boundaries so that all shards have about the same number of nodes. Adjacent shards are
+  /// locked in pairs, and nodes are moved between them by split() and join(). Each shard except
+  /// the last one keeps at least one node when nodes are moved out of it to the left. Calls to
+  /// rebalance() are serialized.
+  void rebalance();
+
+private:
+  struct shard {
+    std::mutex             mutex;
+    tree_type              tree;
+    std::atomic<size_type> count{0};
+  };
+
+  using iterator    = typename tree_type::iterator;
+  using bound_entry = sharded_avl_detail::atomic_bound<bound_type>;
+
+  template <class L, class R>
+  bool less(const L &lhs, const R &rhs) const noexcept {
+    return avl_tree_detail::less(mCompare, lhs, rhs,
+                                 std::integral_constant<bool, tree_type::is_three_way>());
+  }
+
+  /// Whether key belongs to shard. Boundaries of a shard only change while it is locked, so this
+  /// is exact if shard is locked.
+  template <class Key>
+  bool owns(size_type shard, const Key &key) const noexcept {
+    return (shard == 0 || !less(key, mBounds[shard - 1].load())) &&
+           (shard == mBounds.size() || less(key, mBounds[shard].load()));
+  }
+
+  /// Lock the shard of key and return its index.
+  template <class Key>
+  size_type lock_shard(const Key &key, std::unique_lock<std::mutex> &guard);
+
+  /// Shard of key by a binary search over boundaries without locks. It might be stale once
+  /// returned.
+  template <class Key>
+  size_type find_shard(const Key &key) const noexcept;
+
+  /// Change boundary i. Shards i and i + 1 should be locked by rebalance().
+  void set_bound(size_type i, const T &node) noexcept;
+
+  /// Lock the shard after current one and release current one.
+  void lock_next(size_type &shard, std::unique_lock<std::mutex> &guard);
+
+  template <class Key>
+  pointer find_impl(const Key &key);
+  template <class Key>
+  pointer lower_bound_impl(const Key &key);
+
+  /// Iterator to the index-th node of shard.
+  iterator node_at(shard &s, size_type index) noexcept;
+
+  /// Move the last k nodes of shard i to shard i + 1, or the first k nodes of shard i + 1 to shard
+  /// i. Both shards should be locked.
+  void move_right(size_type i, size_type k);
+  void move_left(size_type i, size_type k);
+
+  size_type count_shards(size_type first, size_type last) const noexcept;
+
+  Compare                    mCompare;
+  KeyOf                      mKeyOf;
+  std::vector<bound_entry>   mBounds;
+  std::unique_ptr<shard[]>   mShards;
+  std::mutex                 mRebalance;
+  // Odd while rebalance() is changing a boundary.
+  std::atomic<std::uint64_t> mVersion{0};
+};
+
+template <class T, class Compare, class Node, class KeyOf>
+template <class InputIt>
+sharded_avl_tree<T, Compare, Node, KeyOf>::sharded_avl_tree(InputIt        first,
+                                                            InputIt        last,
+                                                            const Compare &cmp,
+                                                            const KeyOf   &key_of)
+    : mCompare(cmp),
+      mKeyOf(key_of),
+      mBounds(),
+      mShards() {
+  std::vector<bound_type> bounds(first, last);
+  assert(std::is_sorted(
+      bounds.begin(), bounds.end(),
+      [this](const bound_type &lhs, const bound_type &rhs) { return less(lhs, rhs); }));
+
+  mBounds = std::vector<bound_entry>(bounds.size());
+  for (size_type i = 0; i < bounds.size(); ++i)
+    mBounds[i].store(bounds[i]);
+  mShards.reset(new shard[bounds.size() + 1]);
+  for (size_type i = 0; i < shard_count(); ++i)
+    mShards[i].tree = tree_type(cmp);
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+auto sharded_avl_tree<T, Compare, Node, KeyOf>::size() const noexcept -> size_type {
+  return count_shards(0, shard_count());
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+auto sharded_avl_tree<T, Compare, Node, KeyOf>::count_shards(size_type first,
+                                                            size_type last) const noexcept
+    -> size_type {
+  size_type count = 0;
+  for (size_type i = first; i < last; ++i)
+    count += mShards[i].count.load(std::memory_order_relaxed);
+  return count;
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+template <class Key>
+auto sharded_avl_tree<T, Compare, Node, KeyOf>::lock_shard(const Key                    &key,
+                                                           std::unique_lock<std::mutex> &guard)
+    -> size_type {
+  for (;;) {
+    // Boundaries might be changed by rebalance() before the shard is locked, so check again.
+    size_type i = find_shard(key);
+    guard       = std::unique_lock<std::mutex>(mShards[i].mutex);
+    if (owns(i, key))
+      return i;
+    guard.unlock();
+  }
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+template <class Key>
+auto sharded_avl_tree<T, Compare, Node, KeyOf>::find_shard(const Key &key) const noexcept
+    -> size_type {
+  for (;;) {
+    std::uint64_t version = mVersion.load(std::memory_order_acquire);
+    if (version & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    size_type i = std::upper_bound(mBounds.begin(), mBounds.end(), key,
+                                   [this](const Key &k, const bound_entry &bound) {
+                                     return less(k, bound.load());
+                                   }) -
+                  mBounds.begin();
+
+    // Reads of the search happen before reading version again.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (mVersion.load(std::memory_order_relaxed) == version)
+      return i;
+  }
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::set_bound(size_type i, const T &node) noexcept {
+  std::uint64_t version = mVersion.load(std::memory_order_relaxed);
+  mVersion.store(version + 1, std::memory_order_relaxed);
+  // Readers that see the new boundary also see the odd version.
+  std::atomic_thread_fence(std::memory_order_release);
+  mBounds[i].store(mKeyOf(node));
+  mVersion.store(version + 2, std::memory_order_release);
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::lock_next(size_type                    &shard,
+                                                          std::unique_lock<std::mutex> &guard) {
+  std::unique_lock<std::mutex> next(mShards[shard + 1].mutex);
+  guard.swap(next);
+  shard += 1;
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+bool sharded_avl_tree<T, Compare, Node, KeyOf>::insert_unique(pointer node) {
+  std::unique_lock<std::mutex> guard;
+  shard                       &s = mShards[lock_shard(*node, guard)];
+  if (!s.tree.insert_unique(node))
+    return false;
+  s.count.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::insert_multi(pointer node) {
+  std::unique_lock<std::mutex> guard;
+  shard                       &s = mShards[lock_shard(*node, guard)];
+  s.tree.insert_multi(node);
+  s.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::erase(pointer node) {
+  std::unique_lock<std::mutex> guard;
+  shard                       &s = mShards[lock_shard(*node, guard)];
+  s.tree.erase(node);
+  s.count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+template <class Func>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::clear(Func &&handler) {
+  for (size_type i = 0; i < shard_count(); ++i) {
+    std::lock_guard<std::mutex> guard(mShards[i].mutex);
+    mShards[i].tree.clear(handler);
+    mShards[i].count.store(0, std::memory_order_relaxed);
+  }
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+template <class Key>
+auto sharded_avl_tree<T, Compare, Node, KeyOf>::find_impl(const Key &key) -> pointer {
+  std::unique_lock<std::mutex> guard;
+  return mShards[lock_shard(key, guard)].tree.find(key);
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+template <class Key>
+auto sharded_avl_tree<T, Compare, Node, KeyOf>::lower_bound_impl(const Key &key) -> pointer {
+  std::unique_lock<std::mutex> guard;
+  size_type                    i  = lock_shard(key, guard);
+  iterator                     it = mShards[i].tree.lower_bound(key);
+  if (it != mShards[i].tree.end())
+    return &*it;
+
+  // All nodes of the following shards are greater than key.
+  while (i + 1 < shard_count()) {
+    lock_next(i, guard);
+    if (!mShards[i].tree.empty())
+      return &mShards[i].tree.front();
+  }
+  return nullptr;
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+template <class Func>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::for_each(Func &&fn) {
+  size_type                    i = 0;
+  std::unique_lock<std::mutex> guard(mShards[0].mutex);
+  for (;;) {
+    for (auto &node : mShards[i].tree)
+      fn(node);
+    if (i + 1 == shard_count())
+      break;
+    lock_next(i, guard);
+  }
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+template <class Key, class Func>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::for_each_range(const Key &lo,
+                                                               const Key &hi,
+                                                               Func     &&fn) {
+  if (!less(lo, hi))
+    return;
+
+  std::unique_lock<std::mutex> guard;
+  size_type                    i  = lock_shard(lo, guard);
+  iterator                     it = mShards[i].tree.lower_bound(lo);
+  for (;;) {
+    for (; it != mShards[i].tree.end(); ++it) {
+      if (!less(*it, hi))
+        return;
+      fn(*it);
+    }
+
+    if (i + 1 == shard_count() || !less(mBounds[i].load(), hi))
+      return;
+    lock_next(i, guard);
+    it = mShards[i].tree.begin();
+  }
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+auto sharded_avl_tree<T, Compare, Node, KeyOf>::node_at(shard &s, size_type index) noexcept
+    -> iterator {
+  // O(log n) for avl_rank_node, whose iterators are random access.
+  size_type count = s.count.load(std::memory_order_relaxed);
+  if (index <= count / 2)
+    return std::next(s.tree.begin(), index);
+  return std::prev(s.tree.end(), count - index);
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::move_right(size_type i, size_type k) {
+  shard    &left  = mShards[i];
+  shard    &right = mShards[i + 1];
+  size_type count = left.count.load(std::memory_order_relaxed);
+  if (k == 0 || count == 0)
+    return;
+
+  // Nodes equal to the new boundary should all move.
+  size_type index = count - std::min(k, count);
+  iterator  pivot = node_at(left, index);
+  for (; index > 0 && !less(*std::prev(pivot), *pivot); --index)
+    --pivot;
+
+  set_bound(i, *pivot);
+  auto trees = left.tree.split(mBounds[i].load());
+  left.tree  = trees.first;
+  right.tree = tree_type::join2(trees.second, right.tree);
+
+  left.count.store(index, std::memory_order_relaxed);
+  right.count.fetch_add(count - index, std::memory_order_relaxed);
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::move_left(size_type i, size_type k) {
+  shard    &left  = mShards[i];
+  shard    &right = mShards[i + 1];
+  size_type count = right.count.load(std::memory_order_relaxed);
+  if (k == 0 || count <= 1)
+    return;
+
+  // The first node left in shard i + 1 becomes the boundary, so nodes equal to it all stay.
+  size_type index = std::min(k, count - 1);
+  iterator  pivot = node_at(right, index);
+  for (; index > 0 && !less(*std::prev(pivot), *pivot); --index)
+    --pivot;
+  if (index == 0)
+    return;
+
+  set_bound(i, *pivot);
+  auto trees = right.tree.split(mBounds[i].load());
+  left.tree  = tree_type::join2(left.tree, trees.first);
+  right.tree = trees.second;
+
+  left.count.fetch_add(index, std::memory_order_relaxed);
+  right.count.store(count - index, std::memory_order_relaxed);
+}
+
+template <class T, class Compare, class Node, class KeyOf>
+void sharded_avl_tree<T, Compare, Node, KeyOf>::rebalance() {
+  size_type n = shard_count();
+  if (n < 2)
+    return;
+
+  // set_bound() expects a single writer.
+  std::lock_guard<std::mutex> rebalance_guard(mRebalance);
+
+  // Push surplus to the right, then to the left. Each pass cascades along the shards, so both
+  // passes together even out any distribution if no update is running.
+  size_type total = size();
+  for (size_type i = 0; i + 1 < n; ++i) {
+    std::lock_guard<std::mutex> left_guard(mShards[i].mutex);
+    std::lock_guard<std::mutex> right_guard(mShards[i + 1].mutex);
+
+    size_type count   = count_shards(0, i + 1);
+    size_type desired = total * (i + 1) / n;
+    if (count > desired)
+      move_right(i, count - desired);
+  }
+
+  total = size();
+  for (size_type i = n - 1; i-- > 0;) {
+    std::lock_guard<std::mutex> left_guard(mShards[i].mutex);
+    std::lock_guard<std::mutex> right_guard(mShards[i + 1].mutex);
+
+    size_type count   = count_shards(i + 1, n);
+    size_type desired = total - total * (i + 1) / n;
+    if (count > desired)
+      move_left(i, count - desired);
+  }
+}
+
+} // namespace tinystl
+
+#endif // TINYSTL_SHARDED_AVL_TREE_H